@@ -0,0 +1,52 @@
+#ifndef CHESS_BITBOARD_H
+#define CHESS_BITBOARD_H
+
+#include "chess.h"
+#include "tables.h"
+
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
+#define BIT(sq) (1ULL << (sq))
+
+#define FILE_A 0x0101010101010101ULL
+#define FILE_H 0x8080808080808080ULL
+#define RANK_1 0x00000000000000FFULL
+#define RANK_2 0x000000000000FF00ULL
+#define RANK_7 0x00FF000000000000ULL
+#define RANK_8 0xFF00000000000000ULL
+
+static inline int bb_popcount(BITBOARD b) { return __builtin_popcountll(b); }
+
+static inline int bb_lsb(BITBOARD b) { return __builtin_ctzll(b); }
+
+static inline int bb_pop_lsb(BITBOARD* b) {
+    int sq = __builtin_ctzll(*b);
+    *b &= *b - 1;
+    return sq;
+}
+
+static inline int bb_more_than_one(BITBOARD b) { return (b & (b - 1)) != 0; }
+
+static inline BITBOARD magic_attacks(const MAGIC* m, BITBOARD occupied) {
+#ifdef USE_PEXT
+    return m->attacks[_pext_u64(occupied, m->mask)];
+#else
+    return m->attacks[((occupied & m->mask) * m->magic) >> m->shift];
+#endif
+}
+
+static inline BITBOARD rook_attacks(int sq, BITBOARD occupied) {
+    return magic_attacks(&rook_magics[sq], occupied);
+}
+
+static inline BITBOARD bishop_attacks(int sq, BITBOARD occupied) {
+    return magic_attacks(&bishop_magics[sq], occupied);
+}
+
+static inline BITBOARD queen_attacks(int sq, BITBOARD occupied) {
+    return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+}
+
+#endif
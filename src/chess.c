@@ -1,64 +1,119 @@
 #include "chess.h"
 
-#include <stdio.h>
-#include <stdlib.h>
+#include <assert.h>
 #include <string.h>
 
+#include "bitboard.h"
+#include "eval.h"
 #include "helpers.h"
-
-int dir_offsets[8] = {8, 9, 1, -7, -8, -9, -1, 7};
-int num_squares_to_edge[64][8];
-int CHESS_CONSTANTS_INITIALIZED = 0;
-int KNIGHT_MOVE[8][2] = {
-    {-2, -1}, {-2, 1}, {2, -1}, {2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2},
-};
+#include "stats.h"
 
 static inline int is_owner(char p, int owner);
-static inline void chess_update_castle_state(CHESS* chess, MOVE move);
-static inline void chess_update_attacking_squares(CHESS* chess);
+static inline int piece_type(char p);
+static inline int piece_color(char p);
+static inline void chess_put_piece(CHESS* chess, int square, char p);
+static inline void chess_remove_piece(CHESS* chess, int square);
+static inline void chess_eval_update(CHESS* chess, int color, int type,
+                                     int square, int sign);
+static inline void chess_update_castle_state(CHESS* chess, int start, int end);
+static inline uint64_t en_passant_key(char P, char p);
+static inline BITBOARD piece_attacks(char p, int square, BITBOARD occupied);
+static inline void chess_refresh_attacks(CHESS* chess);
+static inline BITBOARD chess_attackers_to(CHESS* chess, int square,
+                                          BITBOARD occupied);
+ALWAYS_INLINE int chess_en_passant_is_legal(CHESS* chess, int start, int end,
+                                            int captured, int us);
+ALWAYS_INLINE void chess_update_attacking_squares_as(CHESS* chess, int us);
 
-static inline void move_list_generate_sliding_moves(MOVE_LIST* move_list,
+ALWAYS_INLINE void move_list_generate_turn(MOVE_LIST* move_list, CHESS* chess,
+                                           int kind, BITBOARD from);
+ALWAYS_INLINE void move_list_generate_pseudo_turn(MOVE_LIST* move_list,
+                                                  CHESS* chess, int kind,
+                                                  BITBOARD from);
+ALWAYS_INLINE int chess_squares_attacked(CHESS* chess, BITBOARD squares,
+                                         int kind, int us);
+ALWAYS_INLINE void move_list_generate(MOVE_LIST* move_list, CHESS* chess,
+                                      int kind, BITBOARD from, int us);
+ALWAYS_INLINE void move_list_generate_sliding_moves(MOVE_LIST* move_list,
                                                     CHESS* chess,
-                                                    int start_square);
-static inline void move_list_generate_knight_moves(MOVE_LIST* move_list,
+                                                    BITBOARD from,
+                                                    BITBOARD targets, int kind,
+                                                    int us);
+ALWAYS_INLINE void move_list_generate_knight_moves(MOVE_LIST* move_list,
                                                    CHESS* chess,
-                                                   int start_square);
-static inline void move_list_generate_pawn_moves(MOVE_LIST* move_list,
-                                                 CHESS* chess,
-                                                 int start_square);
-static inline void move_list_generate_king_moves(MOVE_LIST* move_list,
+                                                   BITBOARD from,
+                                                   BITBOARD targets, int kind,
+                                                   int us);
+ALWAYS_INLINE void move_list_generate_pawn_moves(MOVE_LIST* move_list,
+                                                 CHESS* chess, BITBOARD from,
+                                                 BITBOARD evasions, int kind,
+                                                 int us);
+ALWAYS_INLINE void move_list_generate_king_moves(MOVE_LIST* move_list,
                                                  CHESS* chess,
-                                                 int start_square);
-static inline void move_list_add_verify(MOVE_LIST* move_list, CHESS* chess,
-                                        int start, int end);
-static inline void move_list_add_pawn(MOVE_LIST* move_list, CHESS* chess,
-                                      int start, int end, char do_promote);
+                                                 BITBOARD targets, int kind,
+                                                 int us);
+ALWAYS_INLINE void move_list_add_verify(MOVE_LIST* move_list, CHESS* chess,
+                                        int start, BITBOARD targets, int kind,
+                                        int us);
+static inline void move_list_add_pawn(MOVE_LIST* move_list, int start,
+                                      int end, int do_promote);
 
-static inline void init_chess_constants();
+static inline void move_list_push(MOVE_LIST* move_list, MOVE move);
+static inline int mvv_lva(CHESS* chess, MOVE move);
+static inline void move_picker_score(MOVE_PICKER* picker);
+static inline MOVE move_picker_select(MOVE_PICKER* picker);
+
+static inline CHESS chess_empty();
+static inline int chess_material_is_valid(CHESS* chess);
+static inline void chess_finish_setup(CHESS* chess);
+static inline int chess_en_passant_is_valid(CHESS* chess, int file);
 // INIT
 CHESS init_chess() {
-    if (!CHESS_CONSTANTS_INITIALIZED) init_chess_constants();
-
-    CHESS chess = {
-        .board =
-            "RNBQKBNRPPPPPPPP................................pppppppprnbqkbnr",
-        .w_attacking = {0},
-        .b_attacking = {0},
-        .under_check = 0,
-        .turn = 1,
-        .castle = 0b1111,
-        .K = 60,
-        .k = 4,
-        .P = 0,
-        .p = 0};
+    CHESS chess = {.attacks_from = {0},
+                   .dirty = ~0ULL,
+                   .attacks_epoch = 0,
+                   .pinned = {0},
+                   .pin_dirty = {~0ULL, ~0ULL},
+                   .w_attacking = 0,
+                   .b_attacking = 0,
+                   .checkers = 0,
+                   .under_check = 0,
+                   .turn = 1,
+                   .castle = 0b1111,
+                   .K = 4,
+                   .k = 60,
+                   .P = 0,
+                   .p = 0,
+                   .key = 0,
+                   .eval_mg = 0,
+                   .eval_eg = 0,
+                   .phase = 0};
+    memset(chess.board, NON, 64);
+    char* start =
+        "RNBQKBNRPPPPPPPP................................pppppppprnbqkbnr";
+    for (int i = 0; i < 64; i++)
+        if (start[i] != NON) chess_put_piece(&chess, i, start[i]);
+    chess.key ^= zobrist_castle[(int)chess.castle];
     return chess;
 }
 MOVE init_move(int start, int end, char promote) {
-    MOVE move = {.start = start, .end = end, .promote = promote};
+    MOVE move = start | end << 6;
+    switch (promote) {
+        case 'q':
+            return move | MOVE_PROMOTION | 3 << 12;
+        case 'r':
+            return move | MOVE_PROMOTION | 2 << 12;
+        case 'b':
+            return move | MOVE_PROMOTION | 1 << 12;
+        case 'n':
+            return move | MOVE_PROMOTION;
+    }
     return move;
 }
 MOVE_LIST init_move_list() {
-    MOVE_LIST list = {.moves = {{0}}, .length = 0};
+    // Only length needs a value; zeroing all 256 moves showed up in replay
+    MOVE_LIST list;
+    list.length = 0;
     return list;
 }
 
@@ -66,135 +121,723 @@ void copy_chess(CHESS* old_board, CHESS* new_board) {
     memcpy(new_board, old_board, sizeof(CHESS));
 }
 
-int chess_move(CHESS* chess, MOVE_LIST* move_list, char* move_str) {
-    MOVE move = {
-        .start =
-            ((move_str[0] - 'a') & 0xff) + 8 * ((move_str[1] - '1') & 0xff),
-        .end = ((move_str[2] - 'a') & 0xff) + 8 * ((move_str[3] - '1') & 0xff),
-        .promote = move_str[4] == '\n' ? '\0' : move_str[4]};
-    if (move.start > 63 || move.end > 63) {
-        printf("[ERROR]: Invalid command %s\n", move_str);
-        return 0;
+const char* chess_strerror(CHESS_STATUS status) {
+    switch (status) {
+        case CHESS_OK:
+            return "ok";
+        case CHESS_ERR_FEN_PLACEMENT:
+            return "invalid FEN placement";
+        case CHESS_ERR_FEN_SIDE:
+            return "invalid FEN side to move";
+        case CHESS_ERR_FEN_CASTLE:
+            return "invalid FEN castling rights";
+        case CHESS_ERR_FEN_EN_PASSANT:
+            return "invalid FEN en passant square";
+        case CHESS_ERR_MOVE_SYNTAX:
+            return "invalid move syntax";
+        case CHESS_ERR_NOT_OWN_PIECE:
+            return "no piece of the side to move on the start square";
+        case CHESS_ERR_ILLEGAL_MOVE:
+            return "illegal move";
+        case CHESS_ERR_BUFFER_FULL:
+            return "buffer too small";
+        case CHESS_ERR_IO:
+            return "could not read or write a file";
+        case CHESS_ERR_ALLOC:
+            return "out of memory";
     }
+    return "unknown error";
+}
 
-    if (!is_owner(chess->board[move.start], chess->turn)) {
-        printf("[ERROR]: Current turn: %s; Tried %s, but %c%c is %c\n",
-               chess->turn == 1 ? "white" : "black", move_str, move_str[0],
-               move_str[1], chess->board[move.start]);
-        return 0;
+CHESS_STATUS chess_load_fen(CHESS* chess, const char* fen) {
+    CHESS loaded = chess_empty();
+
+    // Placement, rank 8 first
+    const char* c = fen;
+    int x = 0, y = 7;
+    for (; *c && *c != ' '; c++) {
+        if (*c == '/') {
+            if (x != 8 || y == 0) break;
+            x = 0;
+            y--;
+        } else if (*c >= '1' && *c <= '8') {
+            x += *c - '0';
+        } else if (strchr("PNBRQKpnbrqk", *c) && x < 8) {
+            chess_put_piece(&loaded, 8 * y + x, *c);
+            if (*c == 'K') loaded.K = 8 * y + x;
+            if (*c == 'k') loaded.k = 8 * y + x;
+            x++;
+        } else {
+            break;
+        }
+        if (x > 8) break;
     }
+    if (*c != ' ' || x != 8 || y != 0 || !chess_material_is_valid(&loaded))
+        return CHESS_ERR_FEN_PLACEMENT;
 
-    int is_valid_move = 0;
-    for (int i = 0; i < move_list->length; i++) {
-        MOVE* valid_mv = &move_list->moves[i];
-        if (valid_mv->start == move.start && valid_mv->end == move.end &&
-            valid_mv->promote == move.promote) {
-            is_valid_move = 1;
+    c++;
+    if ((*c != 'w' && *c != 'b') || c[1] != ' ') return CHESS_ERR_FEN_SIDE;
+    loaded.turn = *c == 'w' ? 1 : -1;
+
+    for (c += 2; *c && *c != ' '; c++) {
+        if (*c == 'K')
+            loaded.castle |= 0b0100;
+        else if (*c == 'Q')
+            loaded.castle |= 0b1000;
+        else if (*c == 'k')
+            loaded.castle |= 0b0001;
+        else if (*c == 'q')
+            loaded.castle |= 0b0010;
+        else if (*c != '-')
             break;
+    }
+    if (*c != ' ') return CHESS_ERR_FEN_CASTLE;
+
+    c++;
+    if (c[0] >= 'a' && c[0] <= 'h' && c[1] == (loaded.turn == 1 ? '6' : '3')) {
+        int x = c[0] - 'a';
+        if (!chess_en_passant_is_valid(&loaded, x))
+            return CHESS_ERR_FEN_EN_PASSANT;
+        if (loaded.turn == 1)
+            loaded.p = 1 << (7 - x);
+        else
+            loaded.P = 1 << (7 - x);
+    } else if (c[0] != '-') {
+        return CHESS_ERR_FEN_EN_PASSANT;
+    }
+    // Halfmove and fullmove counters are not tracked
+
+    // The side that just moved cannot have left its king in check
+    if (chess_king_attacked(&loaded, loaded.turn == 1 ? BLACK : WHITE))
+        return CHESS_ERR_FEN_PLACEMENT;
+
+    chess_finish_setup(&loaded);
+    *chess = loaded;
+    return CHESS_OK;
+}
+
+void chess_to_fen(CHESS* chess, char* fen) {
+    char* c = fen;
+    for (int y = 7; y >= 0; y--) {
+        int empty = 0;
+        for (int x = 0; x < 8; x++) {
+            char p = chess->board[8 * y + x];
+            if (p == NON) {
+                empty++;
+                continue;
+            }
+            if (empty) *c++ = '0' + empty;
+            empty = 0;
+            *c++ = p;
         }
+        if (empty) *c++ = '0' + empty;
+        if (y) *c++ = '/';
     }
-    if (!is_valid_move) {
-        printf("[ERROR]: Move %s is not valid\n", move_str);
-        return 0;
+
+    *c++ = ' ';
+    *c++ = chess->turn == 1 ? 'w' : 'b';
+    *c++ = ' ';
+    if (chess->castle & 0b0100) *c++ = 'K';
+    if (chess->castle & 0b1000) *c++ = 'Q';
+    if (chess->castle & 0b0001) *c++ = 'k';
+    if (chess->castle & 0b0010) *c++ = 'q';
+    if (!chess->castle) *c++ = '-';
+
+    *c++ = ' ';
+    unsigned char ep = chess->turn == 1 ? chess->p : chess->P;
+    if (ep) {
+        *c++ = 'a' + 7 - __builtin_ctz(ep);
+        *c++ = chess->turn == 1 ? '6' : '3';
+    } else {
+        *c++ = '-';
+    }
+    strcpy(c, " 0 1");
+}
+
+int chess_pack_position(CHESS* chess, unsigned char* buf) {
+    BITBOARD all = chess->all;
+    for (int i = 0; i < 8; i++) buf[i] = all >> (8 * i);
+
+    // One nibble per piece, color << 3 | type, in square order
+    int n = 8, nibble = 0;
+    while (all) {
+        int sq = bb_pop_lsb(&all);
+        char p = chess->board[sq];
+        int code = piece_color(p) << 3 | piece_type(p);
+        if (nibble)
+            buf[n++] |= code << 4;
+        else
+            buf[n] = code;
+        nibble = !nibble;
+    }
+    if (nibble) n++;
+
+    unsigned char ep = chess->turn == 1 ? chess->p : chess->P;
+    buf[n++] = (chess->turn == 1 ? 0 : 1) | chess->castle << 1;
+    buf[n++] = ep ? 8 - __builtin_ctz(ep) : 0;
+    return n;
+}
+
+int chess_unpack_position(CHESS* chess, const unsigned char* buf,
+                          size_t len) {
+    if (len < 8) return 0;
+    BITBOARD all = 0;
+    for (int i = 0; i < 8; i++) all |= (BITBOARD)buf[i] << (8 * i);
+    size_t n = 8 + (bb_popcount(all) + 1) / 2;
+    if (len < n + 2) return 0;
+
+    CHESS loaded = chess_empty();
+    for (int i = 0; all; i++) {
+        int sq = bb_pop_lsb(&all);
+        int code = (buf[8 + i / 2] >> (i % 2 ? 4 : 0)) & 0xf;
+        if ((code & 7) > KING) return 0;
+        char p = "PNBRQK..pnbrqk"[code];
+        chess_put_piece(&loaded, sq, p);
+        if (p == 'K') loaded.K = sq;
+        if (p == 'k') loaded.k = sq;
+    }
+    if (!chess_material_is_valid(&loaded) || buf[n + 1] > 8) return 0;
+
+    loaded.turn = buf[n] & 1 ? -1 : 1;
+    loaded.castle = (buf[n] >> 1) & 0xf;
+    if (buf[n + 1]) {
+        if (!chess_en_passant_is_valid(&loaded, buf[n + 1] - 1)) return 0;
+        if (loaded.turn == 1)
+            loaded.p = 1 << (8 - buf[n + 1]);
+        else
+            loaded.P = 1 << (8 - buf[n + 1]);
     }
+    if (chess_king_attacked(&loaded, loaded.turn == 1 ? BLACK : WHITE))
+        return 0;
+    chess_finish_setup(&loaded);
+    *chess = loaded;
+    return n + 2;
+}
+
+CHESS_STATUS chess_move(CHESS* chess, const char* move_str) {
+    size_t len = strcspn(move_str, "\r\n");
+    if (len < 4) return CHESS_ERR_MOVE_SYNTAX;
+    int start = ((move_str[0] - 'a') & 0xff) + 8 * ((move_str[1] - '1') & 0xff);
+    int end = ((move_str[2] - 'a') & 0xff) + 8 * ((move_str[3] - '1') & 0xff);
+    if (start > 63 || end > 63) return CHESS_ERR_MOVE_SYNTAX;
+    if (!is_owner(chess->board[start], chess->turn))
+        return CHESS_ERR_NOT_OWN_PIECE;
 
-    // add special cases here
+    MOVE move = chess_parse_move(chess, move_str, len);
+    if (move == MOVE_NONE) return CHESS_ERR_ILLEGAL_MOVE;
     chess_valid_move(chess, move);
+    return CHESS_OK;
+}
 
-    return 1;
+MOVE chess_parse_move(CHESS* chess, const char* str, size_t len) {
+    if (len < 4 || len > 5) return MOVE_NONE;
+    for (int i = 0; i < 4; i += 2)
+        if (str[i] < 'a' || str[i] > 'h' || str[i + 1] < '1' ||
+            str[i + 1] > '8')
+            return MOVE_NONE;
+    int start = (str[0] - 'a') + 8 * (str[1] - '1');
+    int end = (str[2] - 'a') + 8 * (str[3] - '1');
+    char promote = len == 5 ? str[4] : '\0';
+    if (!is_owner(chess->board[start], chess->turn)) return MOVE_NONE;
+
+    // Coordinates alone do not say castling or en passant; the piece does
+    MOVE move = init_move(start, end, promote);
+    if (promote && move_promote(move) != promote) return MOVE_NONE;
+    int type = piece_type(chess->board[start]);
+    int ep_file = (chess->turn == 1 ? chess->p : chess->P) & 0xff;
+    if (type == KING && (end - start == 2 || start - end == 2))
+        move |= MOVE_CASTLE;
+    else if (type == PAWN && ep_file && end % 8 == 7 - bb_lsb(ep_file) &&
+             end / 8 == (chess->turn == 1 ? 5 : 2) && start % 8 != end % 8)
+        move |= MOVE_EN_PASSANT;
+    return chess_is_legal(chess, move) ? move : MOVE_NONE;
 }
 
-void chess_valid_move(CHESS* chess, MOVE move) {
-    chess_update_castle_state(chess, move);
-
-    if ((chess->board[move.start] == 'p' || chess->board[move.start] == 'P')) {
-        if ((move.start / 8) != (move.end / 8) &&
-            // En passant
-            (move.start % 8) != (move.end % 8) &&
-            chess->board[move.end] == NON) {
-            int x_diff = move.end % 8 - move.start % 8;
-            chess->board[(move.start / 8) * 8 + (move.start % 8) + x_diff] =
-                NON;
-        } else if (move.start == move.end + 16 || move.end == move.start + 16) {
-            // Mark en-passantable
-            char* p = chess->turn == 1 ? &chess->P : &chess->p;
-            *p |= (0b1 << (7 - (move.start % 8)));
-        }
+int chess_is_legal(CHESS* chess, MOVE move) {
+    int us = chess->turn == 1 ? WHITE : BLACK;
+    int king = us == WHITE ? chess->K : chess->k;
+    int start = move_start(move);
+    int end = move_end(move);
+    int flag = move_flag(move);
+    if (!(chess->occupied[us] & BIT(start)) ||
+        (chess->occupied[us] & BIT(end)))
+        return 0;
+    // Promotion bits only belong on promotions
+    if (flag != MOVE_PROMOTION && (move >> 12) & 3) return 0;
+
+    chess_update_attacking_squares(chess);
+    BITBOARD attacking =
+        us == WHITE ? chess->b_attacking : chess->w_attacking;
+    int type = piece_type(chess->board[start]);
+
+    if (type == KING) {
+        if (flag == MOVE_NORMAL)
+            return (king_attacks[start] & ~attacking & BIT(end)) != 0;
+        if (flag != MOVE_CASTLE || chess->under_check) return 0;
+        // Same conditions as move_list_generate_king_moves
+        int castle_lr_offset = us == WHITE ? 3 : 1;
+        char correct_rook = us == WHITE ? 'R' : 'r';
+        if (start != (us == WHITE ? 4 : 60)) return 0;
+        if (end == start + 2)
+            return ((chess->castle >> (castle_lr_offset - 1)) & 0b1) &&
+                   !(chess->all & (BIT(start + 1) | BIT(start + 2))) &&
+                   !(attacking & (BIT(start + 1) | BIT(start + 2))) &&
+                   chess->board[start + 3] == correct_rook;
+        if (end == start - 2)
+            return ((chess->castle >> castle_lr_offset) & 0b1) &&
+                   !(chess->all &
+                     (BIT(start - 1) | BIT(start - 2) | BIT(start - 3))) &&
+                   !(attacking & (BIT(start - 1) | BIT(start - 2))) &&
+                   chess->board[start - 4] == correct_rook;
+        return 0;
     }
 
-    if ((chess->board[move.start] == 'K' && move.start == 4) ||
-        (chess->board[move.start] == 'k' && move.start == 60)) {
-        if (move.end == move.start + 2) {
-            chess->board[move.start + 1] = chess->board[move.start + 3];
-            chess->board[move.start + 3] = NON;
-        } else if (move.end == move.start - 2) {
-            chess->board[move.start - 1] = chess->board[move.start - 4];
-            chess->board[move.start - 4] = NON;
+    // Only the king can answer a double check
+    if (bb_more_than_one(chess->checkers)) return 0;
+
+    BITBOARD reach;
+    if (type == PAWN) {
+        int dir_offset = dir_offsets[us == WHITE ? 0 : 4];
+        if (flag == MOVE_EN_PASSANT) {
+            char p = us == WHITE ? chess->p : chess->P;
+            if (!p || end != (us == WHITE ? 40 : 16) + 7 - bb_lsb(p) ||
+                !(pawn_attacks[us][start] & BIT(end)))
+                return 0;
+            return chess_en_passant_is_legal(chess, start, end,
+                                             end - dir_offset, us);
+        }
+        BITBOARD promote_rank = us == WHITE ? RANK_8 : RANK_1;
+        if (flag == MOVE_CASTLE ||
+            (flag == MOVE_PROMOTION) != ((BIT(end) & promote_rank) != 0))
+            return 0;
+
+        reach = pawn_attacks[us][start] & chess->occupied[!us];
+        if (!(chess->all & BIT(start + dir_offset))) {
+            reach |= BIT(start + dir_offset);
+            if ((BIT(start) & (us == WHITE ? RANK_2 : RANK_7)) &&
+                !(chess->all & BIT(start + 2 * dir_offset)))
+                reach |= BIT(start + 2 * dir_offset);
         }
+    } else {
+        if (flag != MOVE_NORMAL) return 0;
+        reach = chess->attacks_from[start];
     }
+    if (!(reach & BIT(end))) return 0;
 
-    chess->board[move.end] = chess->board[move.start];
-    chess->board[move.start] = NON;
+    // A single check must be captured or blocked
+    if (chess->checkers &&
+        !((chess->checkers | between_squares[king][bb_lsb(chess->checkers)]) &
+          BIT(end)))
+        return 0;
+    // A pinned piece can only move along the pin
+    if ((chess->pinned[us] & BIT(start)) &&
+        !(line_squares[king][start] & BIT(end)))
+        return 0;
+    return 1;
+}
 
+void chess_valid_move(CHESS* chess, MOVE move) {
+    UNDO undo;
+    chess_make_move(chess, move, &undo);
+}
+
+void chess_make_move(CHESS* chess, MOVE move, UNDO* undo) {
+    int start = move_start(move);
+    int end = move_end(move);
+
+    undo->castle = chess->castle;
+    undo->P = chess->P;
+    undo->p = chess->p;
+    undo->key = chess->key;
+    undo->captured = chess->board[end];
+    undo->captured_square = end;
+    undo->dirty = chess->dirty;
+    undo->attacks_epoch = chess->attacks_epoch;
+
+    chess->key ^= zobrist_castle[(int)chess->castle] ^
+                  en_passant_key(chess->P, chess->p);
+    chess_update_castle_state(chess, start, end);
+
+    char piece = chess->board[start];
+    char* own_p = chess->turn == 1 ? &chess->P : &chess->p;
     char* other_p = chess->turn == 1 ? &chess->p : &chess->P;
+
+    switch (move_flag(move)) {
+        case MOVE_EN_PASSANT:
+            undo->captured_square = (start / 8) * 8 + (end % 8);
+            undo->captured = chess->board[(int)undo->captured_square];
+            chess_remove_piece(chess, undo->captured_square);
+            break;
+        case MOVE_PROMOTION:
+            piece = chess->turn == 1 ? move_promote(move) - 'a' + 'A'
+                                     : move_promote(move);
+            break;
+        case MOVE_CASTLE:
+            if (end > start) {
+                char rook = chess->board[start + 3];
+                chess_remove_piece(chess, start + 3);
+                chess_put_piece(chess, start + 1, rook);
+            } else {
+                char rook = chess->board[start - 4];
+                chess_remove_piece(chess, start - 4);
+                chess_put_piece(chess, start - 1, rook);
+            }
+            break;
+        default:
+            // Mark en-passantable
+            if ((piece == 'p' || piece == 'P') &&
+                (start == end + 16 || end == start + 16))
+                *own_p |= (0b1 << (7 - (start % 8)));
+    }
+    if (piece == 'K')
+        chess->K = end;
+    else if (piece == 'k')
+        chess->k = end;
+
+    chess_remove_piece(chess, end);
+    chess_remove_piece(chess, start);
+    chess_put_piece(chess, end, piece);
+
     *other_p = 0;
 
+    chess->key ^= zobrist_castle[(int)chess->castle] ^
+                  en_passant_key(chess->P, chess->p) ^ zobrist_black;
     chess->turn *= -1;
 }
 
+void chess_unmake_move(CHESS* chess, MOVE move, UNDO* undo) {
+    int start = move_start(move);
+    int end = move_end(move);
+    chess->turn *= -1;
+
+    char piece = chess->board[end];
+    if (move_flag(move) == MOVE_PROMOTION)
+        piece = chess->turn == 1 ? 'P' : 'p';
+
+    chess_remove_piece(chess, end);
+    chess_put_piece(chess, start, piece);
+    if (undo->captured != NON)
+        chess_put_piece(chess, undo->captured_square, undo->captured);
+
+    if (piece == 'K')
+        chess->K = start;
+    else if (piece == 'k')
+        chess->k = start;
+
+    if (move_flag(move) == MOVE_CASTLE) {
+        if (end > start) {
+            char rook = chess->board[start + 1];
+            chess_remove_piece(chess, start + 1);
+            chess_put_piece(chess, start + 3, rook);
+        } else {
+            char rook = chess->board[start - 1];
+            chess_remove_piece(chess, start - 1);
+            chess_put_piece(chess, start - 4, rook);
+        }
+    }
+
+    chess->castle = undo->castle;
+    chess->P = undo->P;
+    chess->p = undo->p;
+    chess->key = undo->key;
+    if (chess->attacks_epoch == undo->attacks_epoch) chess->dirty = undo->dirty;
+}
+
+void chess_update_attacking_squares(CHESS* chess) {
+    if (chess->turn == 1)
+        chess_update_attacking_squares_as(chess, WHITE);
+    else
+        chess_update_attacking_squares_as(chess, BLACK);
+}
+
 void move_list_generate_moves(MOVE_LIST* move_list, CHESS* chess) {
-    chess_update_attacking_squares(chess);
-    for (int i = 0; i < 64; i++) {
-        char p = chess->board[i];
-        if (is_owner(p, chess->turn)) {
-            if (p == 'K' || p == 'k') {
-                move_list_generate_king_moves(move_list, chess, i);
-            } else if (p == 'Q' || p == 'q' || p == 'R' || p == 'r' ||
-                       p == 'B' || p == 'b') {
-                move_list_generate_sliding_moves(move_list, chess, i);
-            } else if (p == 'N' || p == 'n') {
-                move_list_generate_knight_moves(move_list, chess, i);
-            } else if (p == 'P' || p == 'p') {
-                move_list_generate_pawn_moves(move_list, chess, i);
+    move_list_generate_turn(move_list, chess, GEN_ALL, ~0ULL);
+}
+
+void move_list_generate_captures(MOVE_LIST* move_list, CHESS* chess) {
+    move_list_generate_turn(move_list, chess, GEN_CAPTURES, ~0ULL);
+}
+
+void move_list_generate_quiets(MOVE_LIST* move_list, CHESS* chess) {
+    move_list_generate_turn(move_list, chess, GEN_QUIETS, ~0ULL);
+}
+
+void move_list_generate_tactical(MOVE_LIST* move_list, CHESS* chess) {
+    move_list_generate_turn(move_list, chess, GEN_TACTICAL, ~0ULL);
+}
+
+void move_list_generate_pseudo_legal(MOVE_LIST* move_list, CHESS* chess,
+                                     int kind) {
+    // Each kind gets its own copy of the generators, like the legal ones
+    switch (kind) {
+        case GEN_ALL:
+            move_list_generate_pseudo_turn(move_list, chess, GEN_ALL, ~0ULL);
+            break;
+        case GEN_CAPTURES:
+            move_list_generate_pseudo_turn(move_list, chess, GEN_CAPTURES,
+                                           ~0ULL);
+            break;
+        case GEN_QUIETS:
+            move_list_generate_pseudo_turn(move_list, chess, GEN_QUIETS,
+                                           ~0ULL);
+            break;
+        case GEN_TACTICAL:
+            move_list_generate_pseudo_turn(move_list, chess, GEN_TACTICAL,
+                                           ~0ULL);
+            break;
+    }
+}
+
+/**
+ * @brief Rays and jumps out from the king square, stopping at the first kind
+ * of attacker found. Needs no attack map
+ *
+ */
+int chess_king_attacked(CHESS* chess, int color) {
+    int king = color == WHITE ? chess->K : chess->k;
+    BITBOARD* them = chess->pieces[!color];
+    return (knight_attacks[king] & them[KNIGHT]) ||
+           (pawn_attacks[color][king] & them[PAWN]) ||
+           (bishop_attacks(king, chess->all) & (them[BISHOP] | them[QUEEN])) ||
+           (rook_attacks(king, chess->all) & (them[ROOK] | them[QUEEN])) ||
+           (king_attacks[king] & them[KING]);
+}
+
+void move_list_generate_from(MOVE_LIST* move_list, CHESS* chess,
+                             BITBOARD from) {
+    move_list_generate_turn(move_list, chess, GEN_ALL, from);
+}
+
+void move_list_generate_pseudo_legal_from(MOVE_LIST* move_list, CHESS* chess,
+                                          BITBOARD from) {
+    move_list_generate_pseudo_turn(move_list, chess, GEN_ALL, from);
+}
+
+void move_picker_init(MOVE_PICKER* picker, CHESS* chess, MOVE hash_move) {
+    picker->chess = chess;
+    picker->hash_move = hash_move;
+    picker->stage = PICK_HASH;
+    picker->index = 0;
+    move_list_clear(&picker->list);
+}
+
+void move_picker_init_tactical(MOVE_PICKER* picker, CHESS* chess) {
+    move_picker_init(picker, chess, MOVE_NONE);
+    picker->stage = PICK_TACTICAL_INIT;
+}
+
+BITBOARD chess_attackers(CHESS* chess, int square, int color) {
+    return chess_attackers_to(chess, square, chess->all) &
+           chess->occupied[color];
+}
+
+/**
+ * @brief The swap algorithm: gain[d] is what the side making capture d has
+ * won if the exchange stops there. Removing each attacker from the occupancy
+ * before recomputing the attackers brings in the sliders behind it
+ *
+ */
+int chess_see(CHESS* chess, MOVE move) {
+    int flag = move_flag(move);
+    if (flag == MOVE_CASTLE) return 0;
+    int from = move_start(move), to = move_end(move);
+    int color = piece_color(chess->board[from]);
+    int attacker = piece_type(chess->board[from]);
+    BITBOARD occupied = chess->all;
+    int gain[32], d = 0;
+
+    if (flag == MOVE_EN_PASSANT) {
+        gain[0] = eval_piece_value[PAWN];
+        occupied ^= BIT(color == WHITE ? to - 8 : to + 8);
+    } else {
+        char victim = chess->board[to];
+        gain[0] = victim == NON ? 0 : eval_piece_value[piece_type(victim)];
+    }
+    if (flag == MOVE_PROMOTION) {
+        attacker = KNIGHT + ((move >> 12) & 3);
+        gain[0] += eval_piece_value[attacker] - eval_piece_value[PAWN];
+    }
+
+    BITBOARD from_set = BIT(from);
+    while (from_set && d < 31) {
+        d++;
+        color = !color;
+        gain[d] = eval_piece_value[attacker] - gain[d - 1];
+        // Neither side can do better than stand pat from here on
+        if (MAX(-gain[d - 1], gain[d]) < 0) break;
+        occupied ^= from_set;
+        BITBOARD attackers = chess_attackers_to(chess, to, occupied) &
+                             occupied & chess->occupied[color];
+        from_set = 0;
+        for (int type = PAWN; type <= KING && !from_set; type++) {
+            BITBOARD b = attackers & chess->pieces[color][type];
+            if (b) {
+                from_set = b & -b;
+                attacker = type;
             }
         }
     }
+    while (--d) gain[d - 1] = -MAX(-gain[d - 1], gain[d]);
+    return gain[0];
+}
+
+// Only a plain capture by a more valuable piece can come out behind
+static inline int see_may_lose(CHESS* chess, MOVE move) {
+    char victim = chess->board[move_end(move)];
+    if (move_flag(move) != MOVE_NORMAL || victim == NON) return 0;
+    int attacker = piece_type(chess->board[move_start(move)]);
+    return eval_piece_value[attacker] > eval_piece_value[piece_type(victim)];
 }
 
-void move_list_add(MOVE_LIST* move_list, int start, int end) {
-    if (move_list->length + 1 > MOVE_LIST_MAX) {
-        puts("Move list reached maximum length.");
-        exit(1);
+MOVE move_picker_next(MOVE_PICKER* picker) {
+    MOVE_LIST* list = &picker->list;
+    MOVE move;
+    // The caller searches each move before asking for the next one, which
+    // overwrites the check data, so every stage refreshes it first
+    switch (picker->stage) {
+        case PICK_HASH:
+            picker->stage = PICK_CAPTURES_INIT;
+            if (picker->hash_move != MOVE_NONE) {
+                if (chess_is_legal(picker->chess, picker->hash_move))
+                    return picker->hash_move;
+                picker->hash_move = MOVE_NONE;
+            }
+            // fallthrough
+        case PICK_CAPTURES_INIT:
+            move_list_clear(list);
+            move_list_generate_captures(list, picker->chess);
+            move_picker_score(picker);
+            picker->stage = PICK_CAPTURES;
+            // fallthrough
+        case PICK_CAPTURES:
+            while ((move = move_picker_select(picker)) != MOVE_NONE)
+                if (move != picker->hash_move) return move;
+            picker->stage = PICK_QUIETS_INIT;
+            // fallthrough
+        case PICK_QUIETS_INIT:
+            move_list_clear(list);
+            move_list_generate_quiets(list, picker->chess);
+            picker->index = 0;
+            picker->stage = PICK_QUIETS;
+            // fallthrough
+        case PICK_QUIETS:
+            while (picker->index < list->length) {
+                MOVE move = list->moves[picker->index++];
+                if (move != picker->hash_move) return move;
+            }
+            picker->stage = PICK_DONE;
+            break;
+        case PICK_TACTICAL_INIT:
+            move_list_clear(list);
+            move_list_generate_pseudo_legal(list, picker->chess, GEN_TACTICAL);
+            move_picker_score(picker);
+            picker->stage = PICK_TACTICAL;
+            // fallthrough
+        case PICK_TACTICAL:
+            if ((move = move_picker_select(picker)) != MOVE_NONE) return move;
+            picker->stage = PICK_DONE;
     }
-    move_list->moves[move_list->length] = init_move(start, end, 0);
-    move_list->length++;
+    return MOVE_NONE;
 }
 
-static inline void move_list_add_verify(MOVE_LIST* move_list, CHESS* chess,
-                                        int start, int end) {
-    char* attacking =
-        chess->turn == 1 ? chess->b_attacking : chess->w_attacking;
-    char king = chess->turn == 1 ? 'K' : 'k';
-    if (attacking[start] >= 64 &&  // attacking[start] < 128 &&
-        attacking[end] != attacking[start])
-        return;  // if cur piece is pinned
-    // if king moves to dangerous spot
-    if (chess->board[start] == king && attacking[end] != 0) return;
-    // if king is under check and we try to ignore it
-    if (chess->under_check && chess->board[start] != king &&
-        attacking[end] != 3)
-        return;
-    // TODO: Verify en passant pinning
+CHESS_STATUS move_list_add(MOVE_LIST* move_list, MOVE move) {
+    if (move_list->length >= MOVE_LIST_MAX) return CHESS_ERR_BUFFER_FULL;
+    move_list_push(move_list, move);
+    return CHESS_OK;
+}
+
+CHESS_STATUS chess_legal_moves(CHESS* chess, MOVE* moves, size_t capacity,
+                               int* count) {
+    MOVE_LIST list = init_move_list();
+    move_list_generate_moves(&list, chess);
+    *count = list.length;
+    size_t n = (size_t)list.length < capacity ? (size_t)list.length : capacity;
+    memcpy(moves, list.moves, n * sizeof(MOVE));
+    return n < (size_t)list.length ? CHESS_ERR_BUFFER_FULL : CHESS_OK;
+}
 
-    move_list_add(move_list, start, end);
+/**
+ * @brief Most valuable victim first, then least valuable attacker. Promotions
+ * rank as capturing the piece they promote to, on top of any real victim
+ *
+ */
+static inline int mvv_lva(CHESS* chess, MOVE move) {
+    char victim = chess->board[move_end(move)];
+    int score = 0;
+    if (move_flag(move) == MOVE_EN_PASSANT)
+        score = 8 * (PAWN + 1);
+    else if (victim != NON)
+        score = 8 * (piece_type(victim) + 1);
+    if (move_flag(move) == MOVE_PROMOTION)
+        score += 8 * (KNIGHT + ((move >> 12) & 3) + 1);
+    return score - piece_type(chess->board[move_start(move)]);
 }
 
-void move_list_add_pawn(MOVE_LIST* move_list, CHESS* chess, int start, int end,
-                        char do_promote) {
-    if ((do_promote && move_list->length + 4 > MOVE_LIST_MAX)) {
-        puts("Move list reached maximum length.");
-        exit(1);
+static inline void move_picker_score(MOVE_PICKER* picker) {
+    CHESS* chess = picker->chess;
+    MOVE_LIST* list = &picker->list;
+    for (int i = 0; i < list->length; i++) {
+        MOVE move = list->moves[i];
+        picker->scores[i] = mvv_lva(chess, move);
+        // Below every winning or even capture, above the quiets
+        if (see_may_lose(chess, move) && chess_see(chess, move) < 0)
+            picker->scores[i] -= 1000;
     }
+    picker->index = 0;
+}
+
+/**
+ * @brief Selection sort one step at a time: a cutoff usually comes early and
+ * leaves the rest unsorted
+ *
+ */
+static inline MOVE move_picker_select(MOVE_PICKER* picker) {
+    MOVE_LIST* list = &picker->list;
+    if (picker->index >= list->length) return MOVE_NONE;
+    int best = picker->index;
+    for (int i = best + 1; i < list->length; i++)
+        if (picker->scores[i] > picker->scores[best]) best = i;
+    MOVE move = list->moves[best];
+    list->moves[best] = list->moves[picker->index];
+    picker->scores[best] = picker->scores[picker->index];
+    picker->index++;
+    return move;
+}
+
+/**
+ * @brief Add for the generators, checked only by assert. Reachable material
+ * (chess_material_is_valid) never has more than 218 legal moves, but
+ * pseudo-legal lists keep the moves that leave the king attacked, and no
+ * bound below MOVE_LIST_MAX is known for those
+ *
+ */
+static inline void move_list_push(MOVE_LIST* move_list, MOVE move) {
+    assert(move_list->length < MOVE_LIST_MAX);
+    move_list->moves[move_list->length++] = move;
+}
+
+ALWAYS_INLINE void move_list_add_verify(MOVE_LIST* move_list, CHESS* chess,
+                                        int start, BITBOARD targets, int kind,
+                                        int us) {
+    if (kind & GEN_PSEUDO_LEGAL) {
+        while (targets)
+            move_list_push(move_list,
+                           init_move(start, bb_pop_lsb(&targets), 0));
+        return;
+    }
+    STATS_ADD(verify_calls, 1);
+    STATS_ADD(verify_in_check, chess->under_check);
+    // if cur piece is pinned, it can only slide along the pin
+    if (chess->pinned[us] & BIT(start)) {
+        STATS_ADD(verify_pinned, 1);
+        targets &= line_squares[us == WHITE ? chess->K : chess->k][start];
+    }
+    while (targets)
+        move_list_push(move_list, init_move(start, bb_pop_lsb(&targets), 0));
+}
+
+static inline void move_list_add_pawn(MOVE_LIST* move_list, int start,
+                                      int end, int do_promote) {
     if (do_promote) {
         move_list->moves[move_list->length] = init_move(start, end, 'q');
         move_list->moves[move_list->length + 1] = init_move(start, end, 'r');
@@ -202,281 +845,557 @@ void move_list_add_pawn(MOVE_LIST* move_list, CHESS* chess, int start, int end,
         move_list->moves[move_list->length + 3] = init_move(start, end, 'n');
         move_list->length += 4;
     } else {
-        move_list_add_verify(move_list, chess, start, end);
+        move_list_push(move_list, init_move(start, end, 0));
     }
 }
 
 void move_list_clear(MOVE_LIST* move_list) { move_list->length = 0; }
 
-void print_move_list(MOVE_LIST* list) {
-    printf("\033[36mNumber of moves: %d\n", list->length);
-    for (int i = 0; i < list->length; i++) {
-        printf("%c%c%c%c%c\t", (list->moves[i].start % 8) + 'a',
-               list->moves[i].start / 8 + '1', (list->moves[i].end % 8) + 'a',
-               list->moves[i].end / 8 + '1', list->moves[i].promote);
-    }
-    printf("\033[0m\n");
+/**
+ * @brief Coordinate notation, e.g. e2e4 or e7e8q. str needs room for 6 chars
+ *
+ */
+void move_to_string(MOVE move, char* str) {
+    str[0] = (move_start(move) % 8) + 'a';
+    str[1] = move_start(move) / 8 + '1';
+    str[2] = (move_end(move) % 8) + 'a';
+    str[3] = move_end(move) / 8 + '1';
+    str[4] = move_promote(move);
+    str[5] = '\0';
 }
 
 // HELPERS
 
+/**
+ * @brief A board with no pieces, rights or key, for setting up positions
+ *
+ */
+static inline CHESS chess_empty() {
+    CHESS chess = init_chess();
+    while (chess.all) chess_remove_piece(&chess, bb_lsb(chess.all));
+    chess.key = 0;
+    chess.castle = 0;
+    return chess;
+}
+
+/**
+ * @brief Exactly one king a side, no pawns on the back ranks and no more
+ * pieces than promotions can account for. This bounds the number of legal
+ * moves, which the generators rely on
+ *
+ */
+static inline int chess_material_is_valid(CHESS* chess) {
+    static const int START_COUNT[6] = {8, 2, 2, 2, 1, 1};
+    if ((chess->pieces[WHITE][PAWN] | chess->pieces[BLACK][PAWN]) &
+        (RANK_1 | RANK_8))
+        return 0;
+    for (int color = 0; color < 2; color++) {
+        if (bb_popcount(chess->pieces[color][KING]) != 1) return 0;
+        int promoted = 0;
+        for (int type = KNIGHT; type <= QUEEN; type++)
+            promoted += MAX(0, bb_popcount(chess->pieces[color][type]) -
+                                   START_COUNT[type]);
+        if (bb_popcount(chess->pieces[color][PAWN]) + promoted > 8) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief The pawn that just moved two squares along file can be taken en
+ * passant only if it stands on the passed square, with the two squares it
+ * crossed empty. The generator relies on this instead of checking the target
+ *
+ */
+static inline int chess_en_passant_is_valid(CHESS* chess, int file) {
+    int target = (chess->turn == 1 ? 40 : 16) + file;
+    int behind = target + (chess->turn == 1 ? 8 : -8);
+    int passed = target - (chess->turn == 1 ? 8 : -8);
+    return chess->board[target] == NON && chess->board[behind] == NON &&
+           chess->board[passed] == (chess->turn == 1 ? 'p' : 'P');
+}
+
+/**
+ * @brief Drops castle rights whose king or rook has left its square, then
+ * adds rights, en passant and side to move to a key that so far only holds
+ * the pieces
+ *
+ */
+static inline void chess_finish_setup(CHESS* chess) {
+    if (chess->board[4] != 'K') chess->castle &= ~0b1100;
+    if (chess->board[7] != 'R') chess->castle &= ~0b0100;
+    if (chess->board[0] != 'R') chess->castle &= ~0b1000;
+    if (chess->board[60] != 'k') chess->castle &= ~0b0011;
+    if (chess->board[63] != 'r') chess->castle &= ~0b0001;
+    if (chess->board[56] != 'r') chess->castle &= ~0b0010;
+    chess->key ^= zobrist_castle[(int)chess->castle] ^
+                  en_passant_key(chess->P, chess->p) ^
+                  (chess->turn == 1 ? 0 : zobrist_black);
+}
+
 static inline int is_owner(char p, int owner) {
     if (p >= 'a' && p <= 'z') return -1 == owner;
     if (p >= 'A' && p <= 'Z') return 1 == owner;
     return 0;
 }
 
-static inline void chess_update_castle_state(CHESS* chess, MOVE move) {
-    char c = chess->board[move.start];
-    if (c == 'K')
-        chess->castle &= 0b0011;
-    else if (c == 'k')
-        chess->castle &= 0b1100;
-    else if (c == 'R') {
-        if (move.start == 0)
-            chess->castle &= 0b0111;
-        else if (move.start == 7)
-            chess->castle &= 0b1011;
-    } else if (c == 'r') {
-        if (move.start == 56)
-            chess->castle &= 0b1101;
-        else if (move.start == 63)
-            chess->castle &= 0b1110;
-    }
-}
-
-static inline void chess_update_attacking_squares(CHESS* chess) {
-    // TODO: double check that this is okay
-    chess->under_check = 0;
-
-    char* attacking =
-        chess->turn == 1 ? chess->b_attacking : chess->w_attacking;
-    char king = chess->turn == 1 ? 'K' : 'k';
-    for (int i = 0; i < 64; i++) attacking[i] = 0;
-    for (int i = 0; i < 64; i++) {
-        if (is_owner(chess->board[i], -chess->turn)) {
-            char c = chess->board[i];
-            if (c == 'K' || c == 'k')
-                for (int dir = 0; dir < 8; dir++) {
-                    if (num_squares_to_edge[i][dir] > 0 &&
-                        attacking[i + dir_offsets[dir]] == 0)
-                        attacking[i + dir_offsets[dir]] = 1;
-                }
-            else if (c == 'N' || c == 'n') {
-                for (int dir = 0; dir < 8; dir++) {
-                    int x = i % 8 + KNIGHT_MOVE[dir][0];
-                    int y = i / 8 + KNIGHT_MOVE[dir][1];
-                    if (x >= 0 && x <= 7 && y >= 0 && y <= 7 &&
-                        attacking[x + 8 * y] == 0)
-                        attacking[x + 8 * y] = 1;
-                    if (chess->board[x + 8 * y] == king) {
-                        attacking[i] = 3;
-                        chess->under_check = 1;
-                    }
-                }
-            } else if (c == 'P' || c == 'p') {
-                int dir = chess->turn == 1 ? 4 : 0;  // reversed for pawns
-                int forward_i = i + dir_offsets[dir];
-                if (i % 8 != 7) {
-                    if (attacking[forward_i + 1] == 0)
-                        attacking[forward_i + 1] = 1;
-                    if (chess->board[forward_i + 1] == king) {
-                        attacking[i] = 3;
-                        chess->under_check = 1;
-                    }
-                }
-                if (i % 8 != 0) {
-                    if (attacking[forward_i - 1] == 0)
-                        attacking[i + dir_offsets[dir] - 1] = 1;
-                    if (chess->board[forward_i - 1] == king) {
-                        attacking[i] = 3;
-                        chess->under_check = 1;
-                    }
-                }
-            } else {
-                int start_dir_index = (c == 'B' || c == 'b') ? 1 : 0;
-                int dir_increment = (c == 'Q' || c == 'q') ? 1 : 2;
-
-                for (int dir = start_dir_index; dir < 8; dir += dir_increment) {
-                    int critical_piece = -1;  // check or pin
-                    int is_critical = 0;
-                    for (int n = 0; n < num_squares_to_edge[i][dir]; n++) {
-                        int target_square = i + dir_offsets[dir] * (n + 1);
-                        char target_piece = chess->board[target_square];
-                        if (target_piece != NON) {
-                            if (target_piece == king) {
-                                is_critical = 1;
-                                if (critical_piece == -1) {
-                                    chess->under_check = 1;
-                                    critical_piece = target_square;
-                                    for (n++; n < num_squares_to_edge[i][dir];
-                                         n++) {
-                                        attacking[i + dir_offsets[dir] *
-                                                          (n + 1)] = 2;
-                                    }
-                                    if (!attacking[target_square])
-                                        attacking[target_square] = 1;
-                                }
-                                break;
-                            }
-                            if (critical_piece != -1) {
-                                critical_piece = -1;
-                                break;
-                            }
-                            critical_piece = target_square;
-                            if (!attacking[target_square])
-                                attacking[target_square] = 1;
-                        } else {
-                            if (critical_piece == -1)
-                                if (!attacking[target_square])
-                                    attacking[target_square] = 1;
-                        }
-                    }
-                    if (!is_critical) continue;
-                    int attacking_val =
-                        chess->board[critical_piece] == king ? 3 : i + 64;
-
-                    for (int n = 0; n <= num_squares_to_edge[i][dir]; n++) {
-                        int target_square = i + dir_offsets[dir] * n;
-                        attacking[target_square] = attacking_val;
-                        if (target_square == critical_piece) break;
-                    }
-                }
-            }
+static inline int piece_type(char p) {
+    // Indexed by the lowercase letter, so both colors share an entry. p must
+    // be a piece: NON lands on the knight's slot
+    static const signed char TYPES[32] = {
+        ['b' - 0x60] = BISHOP, ['k' - 0x60] = KING,  ['n' - 0x60] = KNIGHT,
+        ['p' - 0x60] = PAWN,   ['q' - 0x60] = QUEEN, ['r' - 0x60] = ROOK};
+    return TYPES[(p | 0x20) & 31];
+}
+
+static inline int piece_color(char p) { return p >= 'a' ? BLACK : WHITE; }
+
+static inline void chess_put_piece(CHESS* chess, int square, char p) {
+    int color = piece_color(p);
+    chess->board[square] = p;
+    chess->dirty |= BIT(square);
+    chess->key ^= zobrist_pieces[color][piece_type(p)][square];
+    chess->pieces[color][piece_type(p)] |= BIT(square);
+    chess->occupied[color] |= BIT(square);
+    chess->all |= BIT(square);
+    chess_eval_update(chess, color, piece_type(p), square, 1);
+}
+
+static inline void chess_remove_piece(CHESS* chess, int square) {
+    char p = chess->board[square];
+    if (p == NON) return;
+    int color = piece_color(p);
+    chess->board[square] = NON;
+    chess->dirty |= BIT(square);
+    chess->key ^= zobrist_pieces[color][piece_type(p)][square];
+    chess->pieces[color][piece_type(p)] &= ~BIT(square);
+    chess->occupied[color] &= ~BIT(square);
+    chess->all &= ~BIT(square);
+    chess_eval_update(chess, color, piece_type(p), square, -1);
+}
+
+/**
+ * @brief Adds (sign 1) or takes away (sign -1) one piece's evaluation terms.
+ * Every move, capture, promotion and castle goes through chess_put_piece and
+ * chess_remove_piece, in make and unmake alike
+ *
+ */
+static inline void chess_eval_update(CHESS* chess, int color, int type,
+                                     int square, int sign) {
+    chess->phase += sign * eval_phase[type];
+    if (color == BLACK) {
+        square ^= 56;
+        sign = -sign;
+    }
+    chess->eval_mg += sign * eval_mg[type][square];
+    chess->eval_eg += sign * eval_eg[type][square];
+}
+
+static inline char castle_rights_mask(int square) {
+    switch (square) {
+        case 0:
+            return 0b0111;
+        case 7:
+            return 0b1011;
+        case 4:
+            return 0b0011;
+        case 56:
+            return 0b1101;
+        case 63:
+            return 0b1110;
+        case 60:
+            return 0b1100;
+    }
+    return 0b1111;
+}
+
+static inline void chess_update_castle_state(CHESS* chess, int start, int end) {
+    // Moving the king or a rook, or having a rook captured, loses the right
+    chess->castle &= castle_rights_mask(start) & castle_rights_mask(end);
+}
+
+static inline uint64_t en_passant_key(char P, char p) {
+    unsigned char bits = P | p;
+    return bits ? zobrist_en_passant[bb_lsb(bits)] : 0;
+}
+
+static inline BITBOARD piece_attacks(char p, int square, BITBOARD occupied) {
+    switch (piece_type(p)) {
+        case PAWN:
+            return pawn_attacks[piece_color(p)][square];
+        case KNIGHT:
+            return knight_attacks[square];
+        case BISHOP:
+            return bishop_attacks(square, occupied);
+        case ROOK:
+            return rook_attacks(square, occupied);
+        case QUEEN:
+            return queen_attacks(square, occupied);
+        case KING:
+            return king_attacks[square];
+    }
+    return 0;
+}
+
+/**
+ * @brief Bring attacks_from up to date with every square touched since the
+ * last call. A slider's attacks can only have changed if its ray reaches a
+ * touched square, and rays reaching a square do not depend on what stands on
+ * it, so a lookup from each touched square finds all of them
+ *
+ */
+static inline void chess_refresh_attacks(CHESS* chess) {
+    BITBOARD changed = chess->dirty;
+    if (!changed) return;
+    chess->dirty = 0;
+    chess->attacks_epoch++;
+    chess->pin_dirty[WHITE] |= changed;
+    chess->pin_dirty[BLACK] |= changed;
+
+    BITBOARD(*p)[6] = chess->pieces;
+    BITBOARD diagonal = p[WHITE][BISHOP] | p[BLACK][BISHOP] |
+                        p[WHITE][QUEEN] | p[BLACK][QUEEN];
+    BITBOARD orthogonal = p[WHITE][ROOK] | p[BLACK][ROOK] | p[WHITE][QUEEN] |
+                          p[BLACK][QUEEN];
+
+    BITBOARD stale = changed & chess->all;
+    while (changed) {
+        int square = bb_pop_lsb(&changed);
+        chess->attacks_from[square] = 0;
+        stale |= (bishop_attacks(square, chess->all) & diagonal) |
+                 (rook_attacks(square, chess->all) & orthogonal);
+    }
+    while (stale) {
+        int square = bb_pop_lsb(&stale);
+        chess->attacks_from[square] =
+            piece_attacks(chess->board[square], square, chess->all);
+    }
+}
+
+/**
+ * @brief Pieces of either color attacking square, given the occupancy
+ *
+ */
+static inline BITBOARD chess_attackers_to(CHESS* chess, int square,
+                                          BITBOARD occupied) {
+    BITBOARD(*p)[6] = chess->pieces;
+    return (pawn_attacks[BLACK][square] & p[WHITE][PAWN]) |
+           (pawn_attacks[WHITE][square] & p[BLACK][PAWN]) |
+           (knight_attacks[square] & (p[WHITE][KNIGHT] | p[BLACK][KNIGHT])) |
+           (king_attacks[square] & (p[WHITE][KING] | p[BLACK][KING])) |
+           (bishop_attacks(square, occupied) &
+            (p[WHITE][BISHOP] | p[BLACK][BISHOP] | p[WHITE][QUEEN] |
+             p[BLACK][QUEEN])) |
+           (rook_attacks(square, occupied) &
+            (p[WHITE][ROOK] | p[BLACK][ROOK] | p[WHITE][QUEEN] |
+             p[BLACK][QUEEN]));
+}
+
+/**
+ * @brief En passant removes two pieces from a rank at once, so it can expose
+ * the king in ways the pin mask does not see. Replay it on the occupancy and
+ * look for any remaining attacker
+ *
+ */
+ALWAYS_INLINE int chess_en_passant_is_legal(CHESS* chess, int start, int end,
+                                            int captured, int us) {
+    int king = us == WHITE ? chess->K : chess->k;
+    BITBOARD occupied = (chess->all ^ BIT(start) ^ BIT(captured)) | BIT(end);
+    BITBOARD them = chess->occupied[!us] ^ BIT(captured);
+    return !(chess_attackers_to(chess, king, occupied) & them);
+}
+
+/**
+ * @brief chess_update_attacking_squares with the side to move fixed, so the
+ * color lookups fold away
+ *
+ */
+ALWAYS_INLINE void chess_update_attacking_squares_as(CHESS* chess, int us) {
+    int them = !us;
+    int king = us == WHITE ? chess->K : chess->k;
+    STATS_TIMER_START();
+
+    chess_refresh_attacks(chess);
+
+    BITBOARD attacking = 0;
+    chess->checkers = 0;
+    BITBOARD b = chess->occupied[them];
+    while (b) {
+        int square = bb_pop_lsb(&b);
+        attacking |= chess->attacks_from[square];
+        if (chess->attacks_from[square] & BIT(king))
+            chess->checkers |= BIT(square);
+    }
+    chess->under_check = chess->checkers != 0;
+
+    // Sliders see through our king, so it cannot step back along a check ray
+    b = chess->checkers &
+        ~(chess->pieces[them][PAWN] | chess->pieces[them][KNIGHT]);
+    while (b) {
+        int square = bb_pop_lsb(&b);
+        attacking |= line_squares[king][square] & king_attacks[king] &
+                     ~(between_squares[king][square] | BIT(square));
+    }
+    if (us == WHITE)
+        chess->b_attacking = attacking;
+    else
+        chess->w_attacking = attacking;
+
+    // Pins only change when something on the king's lines moved
+    if (chess->pin_dirty[us] & (queen_attacks(king, 0) | BIT(king))) {
+        // A lone piece of ours between the king and an enemy slider is pinned
+        chess->pinned[us] = 0;
+        BITBOARD snipers =
+            (rook_attacks(king, 0) &
+             (chess->pieces[them][ROOK] | chess->pieces[them][QUEEN])) |
+            (bishop_attacks(king, 0) &
+             (chess->pieces[them][BISHOP] | chess->pieces[them][QUEEN]));
+        while (snipers) {
+            BITBOARD blockers =
+                between_squares[king][bb_pop_lsb(&snipers)] & chess->all;
+            if (blockers && !bb_more_than_one(blockers))
+                chess->pinned[us] |= blockers & chess->occupied[us];
         }
     }
+    chess->pin_dirty[us] = 0;
+    STATS_ADD(attack_updates, 1);
+    STATS_TIMER_STOP(attack_update_ns);
+}
+
+/**
+ * @brief Refresh the attack data and generate, with the side to move passed
+ * down as a constant so each color gets its own copy of the generators
+ *
+ */
+ALWAYS_INLINE void move_list_generate_turn(MOVE_LIST* move_list, CHESS* chess,
+                                           int kind, BITBOARD from) {
+    if (chess->turn == 1) {
+        chess_update_attacking_squares_as(chess, WHITE);
+        move_list_generate(move_list, chess, kind, from, WHITE);
+    } else {
+        chess_update_attacking_squares_as(chess, BLACK);
+        move_list_generate(move_list, chess, kind, from, BLACK);
+    }
+}
+
+/**
+ * @brief move_list_generate_turn for pseudo-legal moves, which need no attack
+ * data refreshed first
+ *
+ */
+ALWAYS_INLINE void move_list_generate_pseudo_turn(MOVE_LIST* move_list,
+                                                  CHESS* chess, int kind,
+                                                  BITBOARD from) {
+    if (chess->turn == 1)
+        move_list_generate(move_list, chess, kind | GEN_PSEUDO_LEGAL, from,
+                           WHITE);
+    else
+        move_list_generate(move_list, chess, kind | GEN_PSEUDO_LEGAL, from,
+                           BLACK);
+}
+
+/**
+ * @brief Whether the opponent attacks any of squares. Pseudo-legal generation
+ * has no attack map to read, so it asks the board square by square
+ *
+ */
+ALWAYS_INLINE int chess_squares_attacked(CHESS* chess, BITBOARD squares,
+                                         int kind, int us) {
+    if (!(kind & GEN_PSEUDO_LEGAL))
+        return (squares & (us == WHITE ? chess->b_attacking
+                                       : chess->w_attacking)) != 0;
+    while (squares)
+        if (chess_attackers_to(chess, bb_pop_lsb(&squares), chess->all) &
+            chess->occupied[!us])
+            return 1;
+    return 0;
 }
 
-static inline void move_list_generate_sliding_moves(MOVE_LIST* move_list,
+/**
+ * @brief Generate the moves of one kind (GEN_ALL, GEN_CAPTURES, GEN_QUIETS,
+ * GEN_TACTICAL) for our pieces on the from squares. Expects
+ * chess_update_attacking_squares to have run for this position
+ *
+ */
+ALWAYS_INLINE void move_list_generate(MOVE_LIST* move_list, CHESS* chess,
+                                      int kind, BITBOARD from, int us) {
+    int king = us == WHITE ? chess->K : chess->k;
+    if ((kind & ~GEN_PSEUDO_LEGAL) == GEN_TACTICAL) {
+        int in_check = kind & GEN_PSEUDO_LEGAL ? chess_king_attacked(chess, us)
+                                               : chess->checkers != 0;
+        kind = (kind & GEN_PSEUDO_LEGAL) | (in_check ? GEN_ALL : GEN_CAPTURES);
+    }
+    int base = kind & ~GEN_PSEUDO_LEGAL;
+
+    BITBOARD targets = base == GEN_CAPTURES ? chess->occupied[!us]
+                       : base == GEN_QUIETS ? ~chess->all
+                                            : ~chess->occupied[us];
+#ifdef USE_STATS
+    int length = move_list->length;
+#define STATS_GENERATED(field)                            \
+    STATS_ADD(field, move_list->length - length);        \
+    length = move_list->length
+#else
+#define STATS_GENERATED(field) ((void)0)
+#endif
+    if (from & BIT(king))
+        move_list_generate_king_moves(move_list, chess, targets, kind, us);
+    STATS_GENERATED(moves_king);
+    // Pseudo-legal moves leave checks to chess_king_attacked after the move
+    BITBOARD evasions = ~0ULL;
+    if (!(kind & GEN_PSEUDO_LEGAL) && chess->checkers) {
+        // Only the king can answer a double check
+        if (bb_more_than_one(chess->checkers)) return;
+        // A single check must be captured or blocked
+        evasions = chess->checkers |
+                   between_squares[king][bb_lsb(chess->checkers)];
+    }
+
+    move_list_generate_pawn_moves(move_list, chess, from, evasions, kind, us);
+    STATS_GENERATED(moves_pawn);
+    move_list_generate_knight_moves(move_list, chess, from, targets & evasions,
+                                    kind, us);
+    STATS_GENERATED(moves_knight);
+    move_list_generate_sliding_moves(move_list, chess, from,
+                                     targets & evasions, kind, us);
+    STATS_GENERATED(moves_sliding);
+#undef STATS_GENERATED
+}
+
+ALWAYS_INLINE void move_list_generate_sliding_moves(MOVE_LIST* move_list,
                                                     CHESS* chess,
-                                                    int start_square) {
-    char p = chess->board[start_square];
-    int start_dir_index = (p == 'B' || p == 'b') ? 1 : 0;
-    int dir_increment = (p == 'Q' || p == 'q') ? 1 : 2;
-
-    for (int i = start_dir_index; i < 8; i += dir_increment) {
-        for (int n = 0; n < num_squares_to_edge[start_square][i]; n++) {
-            int target_square = start_square + dir_offsets[i] * (n + 1);
-            int piece_on_target = chess->board[target_square];
-
-            if (is_owner(piece_on_target, chess->turn)) break;
-            move_list_add_verify(move_list, chess, start_square, target_square);
-            if (is_owner(piece_on_target, -chess->turn)) break;
-        }
+                                                    BITBOARD from,
+                                                    BITBOARD targets, int kind,
+                                                    int us) {
+    BITBOARD* pieces = chess->pieces[us];
+
+    BITBOARD b = (pieces[BISHOP] | pieces[QUEEN]) & from;
+    while (b) {
+        int start_square = bb_pop_lsb(&b);
+        move_list_add_verify(move_list, chess, start_square,
+                             bishop_attacks(start_square, chess->all) &
+                                 targets,
+                             kind, us);
+    }
+    b = (pieces[ROOK] | pieces[QUEEN]) & from;
+    while (b) {
+        int start_square = bb_pop_lsb(&b);
+        move_list_add_verify(move_list, chess, start_square,
+                             rook_attacks(start_square, chess->all) &
+                                 targets,
+                             kind, us);
     }
 }
 
-static inline void move_list_generate_knight_moves(MOVE_LIST* move_list,
+ALWAYS_INLINE void move_list_generate_knight_moves(MOVE_LIST* move_list,
                                                    CHESS* chess,
-                                                   int start_square) {
-    for (int i = 0; i < 8; i++) {
-        int x = start_square % 8 + KNIGHT_MOVE[i][0];
-        int y = start_square / 8 + KNIGHT_MOVE[i][1];
-        int potential_i = 8 * y + x;
-        if (x < 0 || x > 7 || y < 0 || y > 7 ||
-            is_owner(chess->board[potential_i], chess->turn))
-            continue;
-        move_list_add_verify(move_list, chess, start_square, potential_i);
+                                                   BITBOARD from,
+                                                   BITBOARD targets, int kind,
+                                                   int us) {
+    // A pinned knight can never stay on the pin line
+    BITBOARD b = chess->pieces[us][KNIGHT] & from;
+    if (!(kind & GEN_PSEUDO_LEGAL)) b &= ~chess->pinned[us];
+    while (b) {
+        int start_square = bb_pop_lsb(&b);
+        move_list_add_verify(move_list, chess, start_square,
+                             knight_attacks[start_square] & targets, kind, us);
     }
 }
 
-static inline void move_list_generate_pawn_moves(MOVE_LIST* move_list,
-                                                 CHESS* chess,
-                                                 int start_square) {
-    int direction = chess->turn == 1 ? 0 : 4;
-    int dir_offset = dir_offsets[direction];
-    int can_promote = num_squares_to_edge[start_square][direction] == 1;
-
-    if (num_squares_to_edge[start_square][direction] >= 1) {
-        if (chess->board[start_square + dir_offset] == NON) {
-            // Move forward
-            move_list_add_pawn(move_list, chess, start_square,
-                               start_square + dir_offset, can_promote);
+ALWAYS_INLINE void move_list_generate_pawn_moves(MOVE_LIST* move_list,
+                                                 CHESS* chess, BITBOARD from,
+                                                 BITBOARD evasions, int kind,
+                                                 int us) {
+    int king = us == WHITE ? chess->K : chess->k;
+    int dir_offset = dir_offsets[us == WHITE ? 0 : 4];
+    BITBOARD double_rank = us == WHITE ? RANK_2 : RANK_7;
+    BITBOARD promote_rank = us == WHITE ? RANK_8 : RANK_1;
+    int pseudo = kind & GEN_PSEUDO_LEGAL;
+    kind &= ~GEN_PSEUDO_LEGAL;
+
+    // Promotions count as captures, whether or not they take something
+    BITBOARD capture_targets = kind == GEN_QUIETS ? 0 : chess->occupied[!us];
+    BITBOARD push_targets = kind == GEN_CAPTURES ? promote_rank
+                            : kind == GEN_QUIETS ? ~promote_rank
+                                                 : ~0ULL;
+    BITBOARD pinned = pseudo ? 0 : chess->pinned[us];
+
+    BITBOARD b = chess->pieces[us][PAWN] & from;
+    while (b) {
+        int start_square = bb_pop_lsb(&b);
+        int forward = start_square + dir_offset;
+        BITBOARD moves = pawn_attacks[us][start_square] & capture_targets;
+
+        if (!(chess->all & BIT(forward))) {
+            BITBOARD pushes = BIT(forward);
             // Double move forward
-            int opposite = (direction + 4) % 8;
-            if (num_squares_to_edge[start_square][opposite] == 1 &&
-                chess->board[start_square + dir_offset * 2] == NON) {
-                move_list_add_verify(move_list, chess, start_square,
-                                     start_square + dir_offset * 2);
-            }
+            if ((BIT(start_square) & double_rank) &&
+                !(chess->all & BIT(forward + dir_offset)))
+                pushes |= BIT(forward + dir_offset);
+            moves |= pushes & push_targets;
         }
 
-        char p = chess->turn == 1 ? chess->p : chess->P;
-
-        // Capture
-        int x = start_square % 8;
-        if (x != 7) {
-            if (is_owner(chess->board[start_square + dir_offset + 1],
-                         -chess->turn))
-                move_list_add_pawn(move_list, chess, start_square,
-                                   start_square + dir_offset + 1, can_promote);
-            else if (num_squares_to_edge[start_square][direction] == 3 &&
-                     ((p >> (7 - (x + 1))) & 0b1))
-                move_list_add_verify(move_list, chess, start_square,
-                                     start_square + dir_offset + 1);
+        moves &= evasions;
+        if (pinned & BIT(start_square))
+            moves &= line_squares[king][start_square];
+        while (moves) {
+            int end = bb_pop_lsb(&moves);
+            move_list_add_pawn(move_list, start_square, end,
+                               (BIT(end) & promote_rank) != 0);
         }
-        if (x != 0) {
-            if (is_owner(chess->board[start_square + dir_offset - 1],
-                         -chess->turn))
-                move_list_add_pawn(move_list, chess, start_square,
-                                   start_square + dir_offset - 1, can_promote);
-            else if (num_squares_to_edge[start_square][direction] == 3 &&
-                     ((p >> (7 - (x - 1))) & 0b1))
-                move_list_add_verify(move_list, chess, start_square,
-                                     start_square + dir_offset - 1);
+    }
+
+    // En passant
+    char p = us == WHITE ? chess->p : chess->P;
+    if (p && kind != GEN_QUIETS) {
+        int x = 7 - bb_lsb(p);
+        int end = (us == WHITE ? 40 : 16) + x;
+        int captured = end - dir_offset;
+        b = pawn_attacks[!us][end] & chess->pieces[us][PAWN] & from;
+        while (b) {
+            int start_square = bb_pop_lsb(&b);
+            if (pseudo || chess_en_passant_is_legal(chess, start_square, end,
+                                                    captured, us))
+                move_list_push(move_list, init_move(start_square, end, 0) |
+                                             MOVE_EN_PASSANT);
         }
     }
 }
 
-static inline void move_list_generate_king_moves(MOVE_LIST* move_list,
+ALWAYS_INLINE void move_list_generate_king_moves(MOVE_LIST* move_list,
                                                  CHESS* chess,
-                                                 int start_square) {
-    char* attacking =
-        chess->turn == 1 ? chess->b_attacking : chess->w_attacking;
-    for (int i = 0; i < 8; i++) {
-        if (num_squares_to_edge[start_square][i] > 0 &&
-            !is_owner(chess->board[start_square + dir_offsets[i]],
-                      chess->turn) &&
-            attacking[start_square + dir_offsets[i]] == 0) {
-            move_list_add_verify(move_list, chess, start_square,
-                                 start_square + dir_offsets[i]);
-        }
-    }
+                                                 BITBOARD targets, int kind,
+                                                 int us) {
+    int start_square = us == WHITE ? chess->K : chess->k;
+    BITBOARD b = king_attacks[start_square] & targets;
+    if (!(kind & GEN_PSEUDO_LEGAL))
+        b &= ~(us == WHITE ? chess->b_attacking : chess->w_attacking);
+    while (b)
+        move_list_push(move_list, init_move(start_square, bb_pop_lsb(&b), 0));
+
+    if ((kind & ~GEN_PSEUDO_LEGAL) == GEN_CAPTURES) return;
+    if (kind & GEN_PSEUDO_LEGAL ? chess_king_attacked(chess, us)
+                                : chess->under_check)
+        return;
 
     // Castling
-    int castle_lr_offset = chess->turn == 1 ? 3 : 1;
-    char correct_rook = chess->turn == 1 ? 'R' : 'r';
+    int castle_lr_offset = us == WHITE ? 3 : 1;
+    char correct_rook = us == WHITE ? 'R' : 'r';
+    if (((chess->castle >> (castle_lr_offset - 1)) & 0b1) &&
+        !(chess->all & (BIT(start_square + 1) | BIT(start_square + 2))) &&
+        !chess_squares_attacked(
+            chess, BIT(start_square + 1) | BIT(start_square + 2), kind, us) &&
+        chess->board[start_square + 3] == correct_rook)
+        move_list_push(move_list,
+                      init_move(start_square, start_square + 2, 0) |
+                          MOVE_CASTLE);
+
     if (((chess->castle >> castle_lr_offset) & 0b1) &&
-        chess->board[start_square + dir_offsets[2]] == NON &&
-        chess->board[start_square + dir_offsets[2] * 2] == NON &&
-        chess->board[start_square + dir_offsets[2] * 3] == correct_rook
-        // TODO: And chess->board[start_square + dir_offsets[2]] is not attacked
-    )
-        move_list_add_verify(move_list, chess, start_square,
-                             start_square + dir_offsets[2] * 2);
-
-    if ((chess->castle >> (castle_lr_offset - 1)) & 0b1 &&
-        chess->board[start_square + dir_offsets[6]] == NON &&
-        chess->board[start_square + dir_offsets[6] * 2] == NON &&
-        chess->board[start_square + dir_offsets[6] * 3] == NON &&
-        chess->board[start_square + dir_offsets[6] * 4] == correct_rook
-        // TODO: And chess->board[start_square + dir_offsets[6]] is not attacked
-    )
-        move_list_add_verify(move_list, chess, start_square,
-                             start_square + dir_offsets[6] * 2);
-}
-
-static inline void init_chess_constants() {
-    for (int rank = 0; rank < 8; rank++) {
-        for (int file = 0; file < 8; file++) {
-            num_squares_to_edge[rank * 8 + file][0] = 7 - rank;
-            num_squares_to_edge[rank * 8 + file][1] = MIN(7 - rank, 7 - file);
-            num_squares_to_edge[rank * 8 + file][2] = 7 - file;
-            num_squares_to_edge[rank * 8 + file][3] = MIN(7 - file, rank);
-            num_squares_to_edge[rank * 8 + file][4] = rank;
-            num_squares_to_edge[rank * 8 + file][5] = MIN(rank, file);
-            num_squares_to_edge[rank * 8 + file][6] = file;
-            num_squares_to_edge[rank * 8 + file][7] = MIN(file, 7 - rank);
-        }
-    }
+        !(chess->all & (BIT(start_square - 1) | BIT(start_square - 2) |
+                        BIT(start_square - 3))) &&
+        !chess_squares_attacked(
+            chess, BIT(start_square - 1) | BIT(start_square - 2), kind, us) &&
+        chess->board[start_square - 4] == correct_rook)
+        move_list_push(move_list,
+                      init_move(start_square, start_square - 2, 0) |
+                          MOVE_CASTLE);
 }
@@ -1,59 +1,422 @@
 #ifndef CHESS_H
 #define CHESS_H
 
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 #define NON '.'
-#define MOVE_LIST_MAX 200
+#define MOVE_LIST_MAX 256
+#define FEN_MAX 92  // longest FEN chess_to_fen writes, with the '\0'
+#define PACKED_MAX 26  // longest position chess_pack_position writes
+
+typedef uint64_t BITBOARD;  // bit i set <=> square i (a1 = 0, h8 = 63)
+
+enum { WHITE, BLACK };
+
+/**
+ * @brief Result of the library calls that can fail. The library never prints
+ * or exits on its own; chess_strerror describes a status for the caller
+ *
+ */
+typedef enum chess_status_e {
+    CHESS_OK,
+    CHESS_ERR_FEN_PLACEMENT,
+    CHESS_ERR_FEN_SIDE,
+    CHESS_ERR_FEN_CASTLE,
+    CHESS_ERR_FEN_EN_PASSANT,
+    CHESS_ERR_MOVE_SYNTAX,
+    CHESS_ERR_NOT_OWN_PIECE,
+    CHESS_ERR_ILLEGAL_MOVE,
+    CHESS_ERR_BUFFER_FULL,
+    CHESS_ERR_IO,
+    CHESS_ERR_ALLOC,
+} CHESS_STATUS;
+enum { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
 
 /**
  * @brief Offset on chess board starting from UP, going clockwise
  *
  */
-extern int dir_offsets[8];
-extern int num_squares_to_edge[64][8];
-extern int CHESS_CONSTANTS_INITIALIZED;
+extern const int dir_offsets[8];
+extern const int num_squares_to_edge[64][8];
 
 typedef struct chess_s {
     char board[64];
+    BITBOARD pieces[2][6];  // [WHITE/BLACK][PAWN..KING]
+    BITBOARD occupied[2];   // [WHITE/BLACK]
+    BITBOARD all;
+
+    // Attack set of the piece on each square. Placing or removing a piece
+    // only marks its square dirty; chess_update_attacking_squares then
+    // recomputes the pieces on dirty squares and the sliders whose rays run
+    // through them
+    BITBOARD attacks_from[64];
+    BITBOARD dirty;
+    unsigned attacks_epoch;  // bumped whenever attacks_from is refreshed
+    BITBOARD pinned[2];     // pieces of each color pinned to their own king
+    BITBOARD pin_dirty[2];  // squares changed since pinned[color] was built
 
-    // 1: targeted;
-    // 2: still dangerous for king to go to if in check
-    // 3: stops check;
-    // 64-127: piece at i-64 is pinning something
-    // to the king
-    char w_attacking[64];
-    char b_attacking[64];
+    // Filled in for the side to move by chess_update_attacking_squares:
+    // squares the opponent attacks (seen through our king) and the opponent
+    // pieces giving check
+    BITBOARD w_attacking;
+    BITBOARD b_attacking;
+    BITBOARD checkers;
     int under_check;
     int turn;
     char castle;  // XXXX: white castle L/R; black castle L/R
     char K, k;    // Index of each king 00XXXXXX
     char P, p;  // P/p: pawn can be en passant-ed. Rightmost = 0 index, leftmost
                 // = 7 index
+    uint64_t key;  // Zobrist key of pieces, side to move, castle and P/p
+
+    // Running evaluation, white minus black: material plus piece-square
+    // scores for the middlegame and the endgame, and the game phase
+    int eval_mg, eval_eg;
+    int phase;
 } CHESS;
 
-typedef struct move_s {
-    int start;
-    int end;
-    char promote;
-} MOVE;
+/**
+ * @brief Packed move: bits 0-5 start square, 6-11 end square, 12-13
+ * promotion piece (n, b, r, q), 14-15 one of the MOVE_* flags below
+ *
+ */
+typedef uint16_t MOVE;
+
+#define MOVE_NONE 0  // a1a1, never a real move
+#define MOVE_NORMAL 0
+#define MOVE_PROMOTION (1 << 14)
+#define MOVE_EN_PASSANT (2 << 14)
+#define MOVE_CASTLE (3 << 14)
+
+static inline int move_start(MOVE move) { return move & 0x3f; }
+static inline int move_end(MOVE move) { return (move >> 6) & 0x3f; }
+static inline int move_flag(MOVE move) { return move & (3 << 14); }
+static inline char move_promote(MOVE move) {
+    return move_flag(move) == MOVE_PROMOTION ? "nbrq"[(move >> 12) & 3] : 0;
+}
+
+/**
+ * @brief Everything chess_make_move destroys, so chess_unmake_move can put the
+ * position back in place
+ *
+ */
+typedef struct undo_s {
+    char captured;         // NON if nothing was captured
+    char captured_square;  // differs from the move end for en passant
+    char castle;
+    char P, p;
+    uint64_t key;
+    // If attacks_from was not refreshed below this move, unmaking it puts the
+    // dirty set back instead of growing it
+    BITBOARD dirty;
+    unsigned attacks_epoch;
+} UNDO;
 
 typedef struct move_list_s {
-    MOVE moves[MOVE_LIST_MAX];
     int length;
+    MOVE moves[MOVE_LIST_MAX];
 } MOVE_LIST;
 
+// Move generation kinds; promotions count as captures. GEN_TACTICAL is
+// GEN_CAPTURES out of check and GEN_ALL, which is only evasions, in check
+#define GEN_ALL 0
+#define GEN_CAPTURES 1
+#define GEN_QUIETS 2
+#define GEN_TACTICAL 3
+// Flag on a kind: skip the pin and check filtering, see chess_king_attacked
+#define GEN_PSEUDO_LEGAL 4
+
+enum {
+    PICK_HASH,
+    PICK_CAPTURES_INIT,
+    PICK_CAPTURES,
+    PICK_QUIETS_INIT,
+    PICK_QUIETS,
+    PICK_TACTICAL_INIT,
+    PICK_TACTICAL,
+    PICK_DONE
+};
+
+/**
+ * @brief Hands out the hash move, then captures and promotions by MVV-LVA
+ * with the ones chess_see says lose material last, then quiet moves. A stage's
+ * moves are only generated once the previous stage runs out. The tactical
+ * picker skips straight to PICK_TACTICAL_INIT and stops after it
+ *
+ */
+typedef struct move_picker_s {
+    CHESS* chess;
+    MOVE hash_move;
+    int stage;
+    int index;
+    MOVE_LIST list;
+    int scores[MOVE_LIST_MAX];  // Ordering of the captures in list
+} MOVE_PICKER;
+
+#define SEARCH_MAX_PLY 64
+#define SEARCH_MATE 32000  // mate in n plies scores SEARCH_MATE - n
+
+/**
+ * @brief Result of a search, refreshed after every completed depth
+ *
+ */
+typedef struct search_info_s {
+    MOVE best_move;
+    int score;  // centipawns, from the side to move
+    int depth;
+    unsigned long long nodes;
+    long long time_ms;
+    unsigned long long nps;
+    MOVE pv[SEARCH_MAX_PLY];
+    int pv_length;
+} SEARCH_INFO;
+
+/**
+ * @brief Transposition table shared by every search thread. Entries are
+ * written without locks and verified on read, like PERFT_CACHE
+ *
+ */
+typedef struct search_tt_s {
+    struct search_entry_s* entries;
+    size_t mask;  // number of entries - 1; the size is a power of two
+} SEARCH_TT;
+
+/**
+ * @brief Per-thread search state, reused by every search it is passed to
+ *
+ */
+typedef struct search_workers_s {
+    struct searcher_s* searchers;
+    int count;  // most threads a search can run with these
+} SEARCH_WORKERS;
+
+typedef struct search_limits_s {
+    int depth;                 // 0: up to SEARCH_MAX_PLY
+    int threads;               // Lazy SMP threads, at least 1
+    SEARCH_TT* tt;             // optional; kept between searches if given
+    SEARCH_WORKERS* workers;   // optional; allocated per search if not given
+    unsigned long long nodes;  // 0: no limit
+    long long movetime;        // milliseconds, 0: no limit
+    atomic_int* stop;          // optional; set non-zero to stop the search
+    // optional; called after each completed depth
+    void (*report)(const SEARCH_INFO* info, void* data);
+    void* report_data;
+} SEARCH_LIMITS;
+
+#define STATS_MAX_DEPTH SEARCH_MAX_PLY
+
+/**
+ * @brief Hot path counters, summed over every thread. They are only counted
+ * in builds with USE_STATS defined (make STATS=1); otherwise they read as 0
+ *
+ */
+typedef struct chess_stats_s {
+    unsigned long long attack_updates;    // chess_update_attacking_squares
+    unsigned long long attack_update_ns;  // time spent in those calls
+    unsigned long long moves_sliding;     // moves each generator produced
+    unsigned long long moves_knight;
+    unsigned long long moves_pawn;
+    unsigned long long moves_king;
+    unsigned long long verify_calls;  // move_list_add_verify calls
+    unsigned long long verify_pinned;  // of those, for a pinned piece
+    unsigned long long verify_in_check;  // of those, while in check
+    // chess_perft calls by remaining depth, cache hits included
+    unsigned long long perft_nodes[STATS_MAX_DEPTH];
+    unsigned long long search_nodes[STATS_MAX_DEPTH];  // by ply
+} CHESS_STATS;
+
+/**
+ * @brief Fixed-size table of (key, depth) -> perft count. Entries are written
+ * without locks and verified on read, so one cache can be shared by threads
+ *
+ */
+typedef struct perft_cache_s {
+    struct perft_entry_s* entries;
+    size_t mask;  // number of entries - 1; the size is a power of two
+} PERFT_CACHE;
+
+/**
+ * @brief One game of a replayed corpus: where it sits and how far it got
+ *
+ */
+typedef struct corpus_game_s {
+    int file;       // index into the file list given to corpus_replay
+    size_t offset;  // byte offset of the first move in that file
+    size_t size;    // bytes up to the blank line ending the game
+    int moves;      // moves played before the end or the first bad move
+    int valid;      // 0 if a move was malformed or illegal
+} CORPUS_GAME;
+
+typedef struct corpus_s {
+    CORPUS_GAME* games;
+    size_t length;
+    unsigned long long moves;
+    size_t invalid;
+    long long time_ms;  // wall time, mapping and indexing included
+} CORPUS;
+
+/**
+ * @brief Streams games in the binary format: a header, then per game a tag
+ * byte (GAME_TAG_START, or GAME_TAG_SNAPSHOT plus a packed position), the
+ * moves and GAME_END twice. A move is one byte: the high nibble is the moving
+ * piece's rank among its side's pieces in square order, the low nibble its
+ * index in move_list_generate_pseudo_legal_from for that piece. An index of
+ * 15 or more stores 15 and a second byte with the rest
+ *
+ */
+typedef struct game_writer_s {
+    FILE* fp;
+    CHESS chess;
+    int in_game;
+} GAME_WRITER;
+
+typedef struct game_reader_s {
+    FILE* fp;
+    CHESS chess;  // position after the last move read
+    CHESS start;  // initial position, copied for each GAME_TAG_START
+    int in_game;
+} GAME_READER;
+
+#define GAME_TAG_START 1
+#define GAME_TAG_SNAPSHOT 2
+#define GAME_END 0xff  // a move never escapes to a second byte of 0xff
+
 CHESS init_chess();
 MOVE init_move(int start, int end, char promote);
 MOVE_LIST init_move_list();
 
 void copy_chess(CHESS* old_board, CHESS* new_board);
-int chess_move(CHESS* chess, MOVE_LIST* move_list, char* move_str);
+const char* chess_strerror(CHESS_STATUS status);
+
+/**
+ * @brief Sets up chess from a FEN string. On a malformed FEN, material no
+ * game can reach, the side not to move in check or an en passant square with
+ * no pawn to take, leaves chess untouched and returns the CHESS_ERR_FEN_* code
+ *
+ */
+CHESS_STATUS chess_load_fen(CHESS* chess, const char* fen);
+/**
+ * @brief Writes the FEN of chess into fen, which needs room for FEN_MAX
+ * chars. Move counters are not tracked and always come out as 0 1
+ *
+ */
+void chess_to_fen(CHESS* chess, char* fen);
+/**
+ * @brief Binary snapshot: occupancy (8 bytes, little endian), a nibble per
+ * piece in square order, then side/castle and en passant file bytes. Returns
+ * the bytes written, at most PACKED_MAX
+ *
+ */
+int chess_pack_position(CHESS* chess, unsigned char* buf);
+// Bytes read from buf, or 0 if it does not hold a valid snapshot
+int chess_unpack_position(CHESS* chess, const unsigned char* buf, size_t len);
+// Plays the coordinate move in move_str if it is legal
+CHESS_STATUS chess_move(CHESS* chess, const char* move_str);
+/**
+ * @brief The legal move written as str[0..len) in coordinate notation (e2e4,
+ * e7e8q), or MOVE_NONE. Does not print and needs no '\0' terminator
+ *
+ */
+MOVE chess_parse_move(CHESS* chess, const char* str, size_t len);
+/**
+ * @brief Whether move, with its flags, is legal here. Checks it against the
+ * attack and pin data instead of generating moves
+ *
+ */
+int chess_is_legal(CHESS* chess, MOVE move);
 void chess_valid_move(CHESS* chess, MOVE move);
-void update_attacking_squares(CHESS* chess);
+void chess_make_move(CHESS* chess, MOVE move, UNDO* undo);
+void chess_unmake_move(CHESS* chess, MOVE move, UNDO* undo);
+void chess_update_attacking_squares(CHESS* chess);
+// Pieces of color attacking square as the board stands; bb_popcount for count
+BITBOARD chess_attackers(CHESS* chess, int square, int color);
+/**
+ * @brief Static exchange evaluation: the material the side to move ends up
+ * with after move and the best sequence of recaptures on its end square, each
+ * side using its least valuable attacker first. Pins are not considered
+ *
+ */
+int chess_see(CHESS* chess, MOVE move);
+/**
+ * @brief Static evaluation in centipawns from the side to move, tapered
+ * between the middlegame and endgame scores by phase. O(1)
+ *
+ */
+int chess_evaluate(CHESS* chess);
 
 void move_list_generate_moves(MOVE_LIST* move_list, CHESS* chess);
-void move_list_add(MOVE_LIST* move_list, int start, int end);
+void move_list_generate_captures(MOVE_LIST* move_list, CHESS* chess);
+void move_list_generate_quiets(MOVE_LIST* move_list, CHESS* chess);
+// What a quiescence search looks at: captures and promotions, or in check
+// every evasion
+void move_list_generate_tactical(MOVE_LIST* move_list, CHESS* chess);
+/**
+ * @brief The moves of one kind (GEN_ALL, GEN_CAPTURES, GEN_QUIETS,
+ * GEN_TACTICAL) without the legality filter, and without building the attack
+ * map it needs. A move is legal if chess_king_attacked(chess, mover) is false
+ * once it is made. Castling is fully checked here
+ *
+ */
+void move_list_generate_pseudo_legal(MOVE_LIST* move_list, CHESS* chess,
+                                     int kind);
+// Whether color's king is attacked; cheaper than a full attack map update
+int chess_king_attacked(CHESS* chess, int color);
+// Legal moves of the side to move's pieces on the squares of from
+void move_list_generate_from(MOVE_LIST* move_list, CHESS* chess,
+                             BITBOARD from);
+// move_list_generate_pseudo_legal's GEN_ALL moves of the pieces on from
+void move_list_generate_pseudo_legal_from(MOVE_LIST* move_list, CHESS* chess,
+                                          BITBOARD from);
+/**
+ * @brief Writes the legal moves into the caller's moves[0..capacity) and their
+ * number into count. If they do not fit, the first capacity are written and
+ * CHESS_ERR_BUFFER_FULL is returned
+ *
+ */
+CHESS_STATUS chess_legal_moves(CHESS* chess, MOVE* moves, size_t capacity,
+                               int* count);
+CHESS_STATUS move_list_add(MOVE_LIST* move_list, MOVE move);
 void move_list_clear(MOVE_LIST* move_list);
 
-void print_move_list(MOVE_LIST* list);
+void move_to_string(MOVE move, char* str);
+
+void move_picker_init(MOVE_PICKER* picker, CHESS* chess, MOVE hash_move);
+// Only the move_list_generate_tactical moves, best captures first. They are
+// pseudo-legal: the caller checks chess_king_attacked after making each
+void move_picker_init_tactical(MOVE_PICKER* picker, CHESS* chess);
+MOVE move_picker_next(MOVE_PICKER* picker);
+
+// 1 if this build was made with USE_STATS
+int chess_stats_enabled();
+void chess_stats_get(CHESS_STATS* stats);
+void chess_stats_reset();
+
+int perft_cache_init(PERFT_CACHE* cache, size_t megabytes);
+void perft_cache_free(PERFT_CACHE* cache);
+unsigned long long chess_perft(CHESS* chess, int depth, PERFT_CACHE* cache);
+
+int game_writer_open(GAME_WRITER* writer, FILE* fp);
+int game_writer_begin(GAME_WRITER* writer, CHESS* start);
+int game_writer_move(GAME_WRITER* writer, MOVE move);
+int game_writer_end(GAME_WRITER* writer);
+int game_reader_open(GAME_READER* reader, FILE* fp);
+int game_reader_next_game(GAME_READER* reader);
+MOVE game_reader_next_move(GAME_READER* reader);
+
+CHESS_STATUS corpus_replay(CORPUS* corpus, char** filenames, int n_files,
+                           int threads);
+void corpus_free(CORPUS* corpus);
+
+int search_tt_init(SEARCH_TT* tt, size_t megabytes);
+void search_tt_clear(SEARCH_TT* tt);
+void search_tt_free(SEARCH_TT* tt);
+int search_workers_init(SEARCH_WORKERS* workers, int count);
+void search_workers_free(SEARCH_WORKERS* workers);
+SEARCH_LIMITS init_search_limits();
+void chess_search(CHESS* chess, const SEARCH_LIMITS* limits,
+                  SEARCH_INFO* info);
 
 #endif
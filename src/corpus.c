@@ -0,0 +1,179 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "helpers.h"
+
+#define CORPUS_MAX_THREADS 64
+#define CORPUS_CHUNK 64  // games a worker claims at a time
+
+typedef struct corpus_file_s {
+    const char* data;
+    size_t size;
+} CORPUS_FILE;
+
+typedef struct corpus_pool_s {
+    CORPUS* corpus;
+    CORPUS_FILE* files;
+    atomic_size_t next;
+} CORPUS_POOL;
+
+static CHESS_STATUS corpus_index(CORPUS* corpus, CORPUS_FILE* files,
+                                 int n_files);
+static void corpus_replay_game(CORPUS_GAME* game, CORPUS_FILE* file);
+static void* corpus_worker(void* arg);
+
+CHESS_STATUS corpus_replay(CORPUS* corpus, char** filenames, int n_files,
+                           int threads) {
+    corpus->games = NULL;
+    corpus->length = 0;
+    corpus->moves = 0;
+    corpus->invalid = 0;
+    long long start = now_ms();
+
+    CORPUS_FILE* files = calloc(n_files, sizeof(CORPUS_FILE));
+    if (files == NULL) return CHESS_ERR_ALLOC;
+    CHESS_STATUS status = CHESS_OK;
+    for (int i = 0; i < n_files && status == CHESS_OK; i++) {
+        int fd = open(filenames[i], O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            status = CHESS_ERR_IO;
+        } else if (st.st_size > 0) {
+            void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                status = CHESS_ERR_IO;
+            } else {
+                madvise(data, st.st_size, MADV_SEQUENTIAL);
+                files[i].data = data;
+                files[i].size = st.st_size;
+            }
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    if (status == CHESS_OK) status = corpus_index(corpus, files, n_files);
+
+    if (status == CHESS_OK) {
+        CORPUS_POOL pool = {.corpus = corpus, .files = files, .next = 0};
+        if (threads < 1) threads = 1;
+        if (threads > CORPUS_MAX_THREADS) threads = CORPUS_MAX_THREADS;
+        pthread_t handles[CORPUS_MAX_THREADS];
+        int started = 0;
+        for (int i = 1; i < threads; i++) {
+            if (pthread_create(&handles[i], NULL, corpus_worker, &pool)) break;
+            started = i;
+        }
+        corpus_worker(&pool);
+        for (int i = 1; i <= started; i++) pthread_join(handles[i], NULL);
+
+        for (size_t i = 0; i < corpus->length; i++) {
+            corpus->moves += corpus->games[i].moves;
+            corpus->invalid += !corpus->games[i].valid;
+        }
+    }
+
+    for (int i = 0; i < n_files; i++)
+        if (files[i].data) munmap((void*)files[i].data, files[i].size);
+    free(files);
+    corpus->time_ms = now_ms() - start;
+    return status;
+}
+
+void corpus_free(CORPUS* corpus) {
+    free(corpus->games);
+    corpus->games = NULL;
+    corpus->length = 0;
+}
+
+// HELPERS
+
+/**
+ * @brief Splits every file into games, one per run of non-blank lines. The
+ * game array grows by doubling, so nothing is allocated per line
+ *
+ */
+static CHESS_STATUS corpus_index(CORPUS* corpus, CORPUS_FILE* files,
+                                 int n_files) {
+    size_t capacity = 0;
+    for (int f = 0; f < n_files; f++) {
+        const char* data = files[f].data;
+        size_t size = files[f].size;
+        size_t i = 0;
+        while (i < size) {
+            // Skip blank lines between games
+            while (i < size && (data[i] == '\n' || data[i] == '\r')) i++;
+            if (i == size) break;
+            size_t begin = i;
+            while (i < size) {
+                const char* nl = memchr(data + i, '\n', size - i);
+                size_t next = nl ? (size_t)(nl - data) + 1 : size;
+                int blank = next - i == 1 ||
+                            (next - i == 2 && data[i] == '\r');
+                if (blank) break;
+                i = next;
+            }
+
+            if (corpus->length == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                CORPUS_GAME* games =
+                    realloc(corpus->games, capacity * sizeof(CORPUS_GAME));
+                if (games == NULL) return CHESS_ERR_ALLOC;
+                corpus->games = games;
+            }
+            CORPUS_GAME* game = &corpus->games[corpus->length++];
+            game->file = f;
+            game->offset = begin;
+            game->size = i - begin;
+            game->moves = 0;
+            game->valid = 1;
+        }
+    }
+    return CHESS_OK;
+}
+
+/**
+ * @brief Plays the game's moves in place from the mapped file, stopping at
+ * the first malformed or illegal one
+ *
+ */
+static void corpus_replay_game(CORPUS_GAME* game, CORPUS_FILE* file) {
+    CHESS chess = init_chess();
+    const char* c = file->data + game->offset;
+    const char* end = c + game->size;
+    while (c < end) {
+        const char* line_end = memchr(c, '\n', end - c);
+        if (line_end == NULL) line_end = end;
+        size_t len = line_end - c;
+        if (len && c[len - 1] == '\r') len--;
+
+        MOVE move = chess_parse_move(&chess, c, len);
+        if (move == MOVE_NONE) {
+            game->valid = 0;
+            return;
+        }
+        chess_valid_move(&chess, move);
+        game->moves++;
+        c = line_end + 1;
+    }
+}
+
+static void* corpus_worker(void* arg) {
+    CORPUS_POOL* pool = arg;
+    CORPUS* corpus = pool->corpus;
+    for (;;) {
+        size_t i = atomic_fetch_add(&pool->next, CORPUS_CHUNK);
+        if (i >= corpus->length) break;
+        size_t last = i + CORPUS_CHUNK < corpus->length ? i + CORPUS_CHUNK
+                                                        : corpus->length;
+        for (; i < last; i++)
+            corpus_replay_game(&corpus->games[i],
+                               &pool->files[corpus->games[i].file]);
+    }
+    return NULL;
+}
@@ -0,0 +1,163 @@
+#include "eval.h"
+
+#include "helpers.h"
+
+// Material, middlegame then endgame, added to every square below
+#define P_MG 82
+#define P_EG 94
+#define N_MG 337
+#define N_EG 281
+#define B_MG 365
+#define B_EG 297
+#define R_MG 477
+#define R_EG 512
+#define Q_MG 1025
+#define Q_EG 936
+
+// Each table lists rank 1 first, so it reads upside down from white's side
+#define ROW(v, a, b, c, d, e, f, g, h) \
+    v + a, v + b, v + c, v + d, v + e, v + f, v + g, v + h
+
+const short eval_mg[6][64] = {
+    {
+        ROW(P_MG, 0, 0, 0, 0, 0, 0, 0, 0),
+        ROW(P_MG, 5, 10, 10, -20, -20, 10, 10, 5),
+        ROW(P_MG, 5, -5, -10, 0, 0, -10, -5, 5),
+        ROW(P_MG, 0, 0, 0, 20, 20, 0, 0, 0),
+        ROW(P_MG, 5, 5, 10, 25, 25, 10, 5, 5),
+        ROW(P_MG, 10, 10, 20, 30, 30, 20, 10, 10),
+        ROW(P_MG, 50, 50, 50, 50, 50, 50, 50, 50),
+        ROW(P_MG, 0, 0, 0, 0, 0, 0, 0, 0),
+    },
+    {
+        ROW(N_MG, -50, -40, -30, -30, -30, -30, -40, -50),
+        ROW(N_MG, -40, -20, 0, 5, 5, 0, -20, -40),
+        ROW(N_MG, -30, 5, 10, 15, 15, 10, 5, -30),
+        ROW(N_MG, -30, 0, 15, 20, 20, 15, 0, -30),
+        ROW(N_MG, -30, 5, 15, 20, 20, 15, 5, -30),
+        ROW(N_MG, -30, 0, 10, 15, 15, 10, 0, -30),
+        ROW(N_MG, -40, -20, 0, 0, 0, 0, -20, -40),
+        ROW(N_MG, -50, -40, -30, -30, -30, -30, -40, -50),
+    },
+    {
+        ROW(B_MG, -20, -10, -10, -10, -10, -10, -10, -20),
+        ROW(B_MG, -10, 5, 0, 0, 0, 0, 5, -10),
+        ROW(B_MG, -10, 10, 10, 10, 10, 10, 10, -10),
+        ROW(B_MG, -10, 0, 10, 10, 10, 10, 0, -10),
+        ROW(B_MG, -10, 5, 5, 10, 10, 5, 5, -10),
+        ROW(B_MG, -10, 0, 5, 10, 10, 5, 0, -10),
+        ROW(B_MG, -10, 0, 0, 0, 0, 0, 0, -10),
+        ROW(B_MG, -20, -10, -10, -10, -10, -10, -10, -20),
+    },
+    {
+        ROW(R_MG, 0, 0, 0, 5, 5, 0, 0, 0),
+        ROW(R_MG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_MG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_MG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_MG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_MG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_MG, 5, 10, 10, 10, 10, 10, 10, 5),
+        ROW(R_MG, 0, 0, 0, 0, 0, 0, 0, 0),
+    },
+    {
+        ROW(Q_MG, -20, -10, -10, -5, -5, -10, -10, -20),
+        ROW(Q_MG, -10, 0, 5, 0, 0, 0, 0, -10),
+        ROW(Q_MG, -10, 5, 5, 5, 5, 5, 0, -10),
+        ROW(Q_MG, 0, 0, 5, 5, 5, 5, 0, -5),
+        ROW(Q_MG, -5, 0, 5, 5, 5, 5, 0, -5),
+        ROW(Q_MG, -10, 0, 5, 5, 5, 5, 0, -10),
+        ROW(Q_MG, -10, 0, 0, 0, 0, 0, 0, -10),
+        ROW(Q_MG, -20, -10, -10, -5, -5, -10, -10, -20),
+    },
+    {
+        ROW(0, 20, 30, 10, 0, 0, 10, 30, 20),
+        ROW(0, 20, 20, 0, 0, 0, 0, 20, 20),
+        ROW(0, -10, -20, -20, -20, -20, -20, -20, -10),
+        ROW(0, -20, -30, -30, -40, -40, -30, -30, -20),
+        ROW(0, -30, -40, -40, -50, -50, -40, -40, -30),
+        ROW(0, -30, -40, -40, -50, -50, -40, -40, -30),
+        ROW(0, -30, -40, -40, -50, -50, -40, -40, -30),
+        ROW(0, -30, -40, -40, -50, -50, -40, -40, -30),
+    },
+};
+
+// Minor pieces and heavy pieces keep their middlegame squares; pawns are
+// worth more the further they are, and the king heads for the center
+const short eval_eg[6][64] = {
+    {
+        ROW(P_EG, 0, 0, 0, 0, 0, 0, 0, 0),
+        ROW(P_EG, 0, 0, 0, 0, 0, 0, 0, 0),
+        ROW(P_EG, 5, 5, 5, 5, 5, 5, 5, 5),
+        ROW(P_EG, 15, 15, 15, 15, 15, 15, 15, 15),
+        ROW(P_EG, 30, 30, 30, 30, 30, 30, 30, 30),
+        ROW(P_EG, 50, 50, 50, 50, 50, 50, 50, 50),
+        ROW(P_EG, 80, 80, 80, 80, 80, 80, 80, 80),
+        ROW(P_EG, 0, 0, 0, 0, 0, 0, 0, 0),
+    },
+    {
+        ROW(N_EG, -50, -40, -30, -30, -30, -30, -40, -50),
+        ROW(N_EG, -40, -20, 0, 5, 5, 0, -20, -40),
+        ROW(N_EG, -30, 5, 10, 15, 15, 10, 5, -30),
+        ROW(N_EG, -30, 0, 15, 20, 20, 15, 0, -30),
+        ROW(N_EG, -30, 5, 15, 20, 20, 15, 5, -30),
+        ROW(N_EG, -30, 0, 10, 15, 15, 10, 0, -30),
+        ROW(N_EG, -40, -20, 0, 0, 0, 0, -20, -40),
+        ROW(N_EG, -50, -40, -30, -30, -30, -30, -40, -50),
+    },
+    {
+        ROW(B_EG, -20, -10, -10, -10, -10, -10, -10, -20),
+        ROW(B_EG, -10, 5, 0, 0, 0, 0, 5, -10),
+        ROW(B_EG, -10, 10, 10, 10, 10, 10, 10, -10),
+        ROW(B_EG, -10, 0, 10, 10, 10, 10, 0, -10),
+        ROW(B_EG, -10, 5, 5, 10, 10, 5, 5, -10),
+        ROW(B_EG, -10, 0, 5, 10, 10, 5, 0, -10),
+        ROW(B_EG, -10, 0, 0, 0, 0, 0, 0, -10),
+        ROW(B_EG, -20, -10, -10, -10, -10, -10, -10, -20),
+    },
+    {
+        ROW(R_EG, 0, 0, 0, 5, 5, 0, 0, 0),
+        ROW(R_EG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_EG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_EG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_EG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_EG, -5, 0, 0, 0, 0, 0, 0, -5),
+        ROW(R_EG, 5, 10, 10, 10, 10, 10, 10, 5),
+        ROW(R_EG, 0, 0, 0, 0, 0, 0, 0, 0),
+    },
+    {
+        ROW(Q_EG, -20, -10, -10, -5, -5, -10, -10, -20),
+        ROW(Q_EG, -10, 0, 5, 0, 0, 0, 0, -10),
+        ROW(Q_EG, -10, 5, 5, 5, 5, 5, 0, -10),
+        ROW(Q_EG, 0, 0, 5, 5, 5, 5, 0, -5),
+        ROW(Q_EG, -5, 0, 5, 5, 5, 5, 0, -5),
+        ROW(Q_EG, -10, 0, 5, 5, 5, 5, 0, -10),
+        ROW(Q_EG, -10, 0, 0, 0, 0, 0, 0, -10),
+        ROW(Q_EG, -20, -10, -10, -5, -5, -10, -10, -20),
+    },
+    {
+        ROW(0, -50, -30, -30, -30, -30, -30, -30, -50),
+        ROW(0, -30, -30, 0, 0, 0, 0, -30, -30),
+        ROW(0, -30, -10, 20, 30, 30, 20, -10, -30),
+        ROW(0, -30, -10, 30, 40, 40, 30, -10, -30),
+        ROW(0, -30, -10, 30, 40, 40, 30, -10, -30),
+        ROW(0, -30, -10, 20, 30, 30, 20, -10, -30),
+        ROW(0, -30, -20, -10, 0, 0, -10, -20, -30),
+        ROW(0, -50, -40, -30, -20, -20, -30, -40, -50),
+    },
+};
+
+const int eval_phase[6] = {0, 1, 1, 2, 4, 0};
+const int eval_piece_value[6] = {100, 320, 330, 500, 900, 20000};
+
+/**
+ * @brief Blends the running middlegame and endgame totals by how much
+ * material is left. Nothing is scanned
+ *
+ */
+int chess_evaluate(CHESS* chess) {
+    int phase = MIN(chess->phase, EVAL_PHASE_MAX);
+    int score = (chess->eval_mg * phase +
+                 chess->eval_eg * (EVAL_PHASE_MAX - phase)) /
+                EVAL_PHASE_MAX;
+    return chess->turn == 1 ? score : -score;
+}
@@ -0,0 +1,21 @@
+#ifndef CHESS_EVAL_H
+#define CHESS_EVAL_H
+
+#include "chess.h"
+
+#define EVAL_PHASE_MAX 24  // phase with every knight, bishop, rook and queen
+
+/**
+ * @brief Material plus piece-square score of a white piece of each type on
+ * each square, for the middlegame and the endgame. Black reads the mirrored
+ * square. Indexed like the board, a1 = 0
+ *
+ */
+extern const short eval_mg[6][64];
+extern const short eval_eg[6][64];
+extern const int eval_phase[6];  // phase each piece type adds
+// One value per piece type for exchanges: SEE, move ordering and delta
+// pruning. The king's makes any capture of it outweigh the rest
+extern const int eval_piece_value[6];
+
+#endif
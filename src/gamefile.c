@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include "chess.h"
+
+static const char GAME_MAGIC[4] = {'C', 'H', 'S', 'G'};
+#define GAME_VERSION 2  // 1 indexed the legal moves of the piece
+
+int game_writer_open(GAME_WRITER* writer, FILE* fp) {
+    writer->fp = fp;
+    writer->in_game = 0;
+    if (fwrite(GAME_MAGIC, 1, 4, fp) != 4 || fputc(GAME_VERSION, fp) == EOF)
+        return 0;
+    return 1;
+}
+
+/**
+ * @brief Starts a game from start, or from the initial position if start is
+ * NULL. A game still open is ended first
+ *
+ */
+int game_writer_begin(GAME_WRITER* writer, CHESS* start) {
+    if (writer->in_game && !game_writer_end(writer)) return 0;
+    if (start == NULL) {
+        writer->chess = init_chess();
+        if (fputc(GAME_TAG_START, writer->fp) == EOF) return 0;
+    } else {
+        unsigned char buf[PACKED_MAX];
+        int n = chess_pack_position(start, buf);
+        copy_chess(start, &writer->chess);
+        if (fputc(GAME_TAG_SNAPSHOT, writer->fp) == EOF ||
+            fwrite(buf, 1, n, writer->fp) != (size_t)n)
+            return 0;
+    }
+    writer->in_game = 1;
+    return 1;
+}
+
+/**
+ * @brief Writes move and plays it. Returns 0 if it is not legal here
+ *
+ */
+int game_writer_move(GAME_WRITER* writer, MOVE move) {
+    if (!writer->in_game) return 0;
+    CHESS* chess = &writer->chess;
+    if (!chess_is_legal(chess, move)) return 0;
+    BITBOARD own = chess->occupied[chess->turn == 1 ? WHITE : BLACK];
+    int start = move_start(move);
+
+    MOVE_LIST list = init_move_list();
+    move_list_generate_pseudo_legal_from(&list, chess, 1ULL << start);
+    for (int i = 0; i < list.length; i++) {
+        if (list.moves[i] != move) continue;
+        int rank = __builtin_popcountll(own & ((1ULL << start) - 1));
+        int ok = fputc(rank << 4 | (i < 15 ? i : 15), writer->fp) != EOF;
+        if (ok && i >= 15) ok = fputc(i - 15, writer->fp) != EOF;
+        if (!ok) return 0;
+        chess_valid_move(chess, move);
+        return 1;
+    }
+    return 0;
+}
+
+int game_writer_end(GAME_WRITER* writer) {
+    if (!writer->in_game) return 0;
+    writer->in_game = 0;
+    return fputc(GAME_END, writer->fp) != EOF &&
+           fputc(GAME_END, writer->fp) != EOF;
+}
+
+int game_reader_open(GAME_READER* reader, FILE* fp) {
+    char magic[4];
+    reader->fp = fp;
+    reader->start = init_chess();
+    reader->in_game = 0;
+    return fread(magic, 1, 4, fp) == 4 && !memcmp(magic, GAME_MAGIC, 4) &&
+           fgetc(fp) == GAME_VERSION;
+}
+
+/**
+ * @brief Moves to the next game and sets up its start position. Moves left
+ * in the current game are skipped. Returns 1 on a game, 0 at the end of the
+ * file and -1 on corrupt data
+ *
+ */
+int game_reader_next_game(GAME_READER* reader) {
+    while (reader->in_game)
+        if (game_reader_next_move(reader) == MOVE_NONE && reader->in_game)
+            return -1;
+
+    int tag = getc_unlocked(reader->fp);
+    if (tag == EOF) return 0;
+    if (tag == GAME_TAG_START) {
+        copy_chess(&reader->start, &reader->chess);
+    } else if (tag == GAME_TAG_SNAPSHOT) {
+        // Read the fixed part first to learn how many nibble bytes follow
+        unsigned char buf[PACKED_MAX];
+        if (fread(buf, 1, 8, reader->fp) != 8) return -1;
+        BITBOARD all = 0;
+        for (int i = 0; i < 8; i++) all |= (BITBOARD)buf[i] << (8 * i);
+        size_t rest = (__builtin_popcountll(all) + 1) / 2 + 2;
+        if (8 + rest > PACKED_MAX ||
+            fread(buf + 8, 1, rest, reader->fp) != rest ||
+            !chess_unpack_position(&reader->chess, buf, 8 + rest))
+            return -1;
+    } else {
+        return -1;
+    }
+    reader->in_game = 1;
+    return 1;
+}
+
+/**
+ * @brief Reads the next move and plays it on reader->chess. Returns
+ * MOVE_NONE at the end of the game; in_game stays set if the data was corrupt.
+ * Indexing pseudo-legal moves spares the attack map that legal generation and
+ * text replay's chess_is_legal refresh on every move; one
+ * chess_king_attacked after the move catches a corrupt index instead
+ *
+ */
+MOVE game_reader_next_move(GAME_READER* reader) {
+    if (!reader->in_game) return MOVE_NONE;
+    CHESS* chess = &reader->chess;
+    int code = getc_unlocked(reader->fp);
+    if (code == EOF) return MOVE_NONE;
+    int index = code & 15;
+    if (index == 15) {
+        int rest = getc_unlocked(reader->fp);
+        if (rest == EOF) return MOVE_NONE;
+        if (code == GAME_END && rest == GAME_END) {
+            reader->in_game = 0;
+            return MOVE_NONE;
+        }
+        index += rest;
+    }
+
+    // Select the moving piece by its rank among the side's pieces
+    BITBOARD own = chess->occupied[chess->turn == 1 ? WHITE : BLACK];
+    for (int rank = code >> 4; rank > 0 && own; rank--) own &= own - 1;
+    if (!own) return MOVE_NONE;
+
+    MOVE_LIST list = init_move_list();
+    move_list_generate_pseudo_legal_from(&list, chess, own & -own);
+    if (index >= list.length) return MOVE_NONE;
+    MOVE move = list.moves[index];
+    int us = chess->turn == 1 ? WHITE : BLACK;
+    chess_valid_move(chess, move);
+    if (chess_king_attacked(chess, us)) return MOVE_NONE;
+    return move;
+}
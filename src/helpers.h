@@ -1,6 +1,10 @@
 #ifndef CHESS_HELPERS_H
 #define CHESS_HELPERS_H
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
 #define MAX(a, b)               \
     ({                          \
         __typeof__(a) _a = (a); \
@@ -15,4 +19,37 @@
         _a < _b ? _a : _b;      \
     })
 
+// Forces inlining so constant arguments, like a color, specialize the body
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+// Monotonic clock in milliseconds, for timing
+static inline long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Zeroed hash table with the most entries of entry_size that fit in
+ * megabytes, rounded down to a power of two and at least one, so a key
+ * indexes it with key & *mask. NULL if the allocation fails
+ *
+ */
+static inline void* hash_table_alloc(size_t megabytes, size_t entry_size,
+                                     size_t* mask) {
+    size_t entries = 1;
+    while (entries * 2 * entry_size <= megabytes << 20) entries *= 2;
+    void* table = calloc(entries, entry_size);
+    if (table) *mask = entries - 1;
+    return table;
+}
+
+// xorshift64*
+static inline uint64_t random_u64(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
 #endif
\ No newline at end of file
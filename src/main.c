@@ -1,29 +1,106 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "chess.h"
 
+// Builds the whole board in one buffer and writes it at once
 void print_chess_board(char board[64], int is_number) {
-    puts("+---+---+---+---+---+---+---+---+");
+    static const char RULE[] = "+---+---+---+---+---+---+---+---+\n";
+    char out[(sizeof(RULE) - 1) * 9 + 8 * 35 + 1];
+    char* c = out;
+    memcpy(c, RULE, sizeof(RULE) - 1);
+    c += sizeof(RULE) - 1;
     for (int y = 7; y >= 0; y--) {
-        putc('|', stdout);
+        *c++ = '|';
         for (int x = 0; x < 8; x++) {
-            if (!is_number || board[8 * y + x] < 100) putc(' ', stdout);
+            int v = board[8 * y + x];
             if (is_number)
-                printf("%d", board[8 * y + x]);
+                c += sprintf(c, v < 10 ? " %d " : "%3d", v);
             else
-                putc((is_number ? '0' : 0) + board[8 * y + x], stdout);
-            if (!is_number || board[8 * y + x] < 10) putc(' ', stdout);
-            putc('|', stdout);
+                c += sprintf(c, " %c ", v);
+            *c++ = '|';
         }
-        putc(' ', stdout);
-        putc('\n', stdout);
-        puts("+---+---+---+---+---+---+---+---+");
+        *c++ = ' ';
+        *c++ = '\n';
+        memcpy(c, RULE, sizeof(RULE) - 1);
+        c += sizeof(RULE) - 1;
     }
+    fwrite(out, 1, c - out, stdout);
 }
 
-void read_chess_file(char* filename, CHESS* chess, MOVE_LIST* list) {
+void print_move_list(MOVE_LIST* list) {
+    printf("\033[36mNumber of moves: %d\n", list->length);
+    for (int i = 0; i < list->length; i++) {
+        MOVE move = list->moves[i];
+        printf("%c%c%c%c%c\t", (move_start(move) % 8) + 'a',
+               move_start(move) / 8 + '1', (move_end(move) % 8) + 'a',
+               move_end(move) / 8 + '1', move_promote(move));
+    }
+    printf("\033[0m\n");
+}
+
+/**
+ * @brief Plays move_str, or prints why it cannot be played. chess is left as
+ * it was on failure, so the error can show what is on the start square
+ *
+ */
+void play_move(CHESS* chess, char* move_str) {
+    CHESS_STATUS status = chess_move(chess, move_str);
+    if (status == CHESS_ERR_MOVE_SYNTAX) {
+        printf("[ERROR]: Invalid command %s\n", move_str);
+    } else if (status == CHESS_ERR_NOT_OWN_PIECE) {
+        int start = (move_str[0] - 'a') + 8 * (move_str[1] - '1');
+        printf("[ERROR]: Current turn: %s; Tried %s, but %c%c is %c\n",
+               chess->turn == 1 ? "white" : "black", move_str, move_str[0],
+               move_str[1], chess->board[start]);
+    } else if (status != CHESS_OK) {
+        printf("[ERROR]: Move %s is not valid\n", move_str);
+    }
+}
+
+void print_search_info(const SEARCH_INFO* info, void* data) {
+    char str[6];
+    printf("depth %d score %d nodes %llu nps %llu time %lld pv", info->depth,
+           info->score, info->nodes, info->nps, info->time_ms);
+    for (int i = 0; i < info->pv_length; i++) {
+        move_to_string(info->pv[i], str);
+        printf(" %s", str);
+    }
+    putc('\n', stdout);
+}
+
+/**
+ * @brief One line of "name value" pairs; the per depth counters are listed
+ * as depth:count up to the last non-zero one
+ *
+ */
+void print_stats() {
+    CHESS_STATS stats;
+    chess_stats_get(&stats);
+    printf("stats enabled %d attack_updates %llu attack_update_ns %llu "
+           "moves_sliding %llu moves_knight %llu moves_pawn %llu moves_king "
+           "%llu verify_calls %llu verify_pinned %llu verify_in_check %llu",
+           chess_stats_enabled(), stats.attack_updates, stats.attack_update_ns,
+           stats.moves_sliding, stats.moves_knight, stats.moves_pawn,
+           stats.moves_king, stats.verify_calls, stats.verify_pinned,
+           stats.verify_in_check);
+    const char* names[2] = {"perft_nodes", "search_nodes"};
+    unsigned long long* counts[2] = {stats.perft_nodes, stats.search_nodes};
+    for (int k = 0; k < 2; k++) {
+        int last = STATS_MAX_DEPTH - 1;
+        while (last >= 0 && !counts[k][last]) last--;
+        printf(" %s", names[k]);
+        for (int i = 0; i <= last; i++) printf(" %d:%llu", i, counts[k][i]);
+    }
+    putc('\n', stdout);
+}
+
+void read_chess_file(char* filename, CHESS* chess) {
     FILE* fp;
     char* line = NULL;
     size_t len = 0;
@@ -36,8 +113,6 @@ void read_chess_file(char* filename, CHESS* chess, MOVE_LIST* list) {
     }
 
     while ((read = getline(&line, &len, fp)) != -1) {
-        move_list_clear(list);
-        move_list_generate_moves(list, chess);
         len = strnlen(line, len);
 
         // Make move
@@ -45,48 +120,654 @@ void read_chess_file(char* filename, CHESS* chess, MOVE_LIST* list) {
         } else if (len < 5 || len > 6) {
             printf("[ERROR]: Invalid command %s; len: %lu\n", line, len);
         } else {
-            chess_move(chess, list, line);
+            play_move(chess, line);
         }
     }
     fclose(fp);
     if (line) free(line);
 }
 
+/**
+ * @brief Streams an EPD file (or stdin for "-"), one position per line, and
+ * prints "<fen>\t<result>" for each. op is count (legal moves), perft (arg =
+ * depth) or search (arg = milliseconds, prints best move and score)
+ *
+ */
+int run_epd(char* filename, char* op, int arg) {
+    int kind = !strcmp(op, "count")    ? 0
+               : !strcmp(op, "perft")  ? 1
+               : !strcmp(op, "search") ? 2
+                                       : -1;
+    if (kind < 0 || (kind > 0 && arg < 1)) {
+        printf("[ERROR]: Invalid EPD operation %s %d\n", op, arg);
+        return 1;
+    }
+
+    FILE* fp = strcmp(filename, "-") ? fopen(filename, "rb") : stdin;
+    if (fp == NULL) {
+        printf("Could not read file `%s`\n", filename);
+        return 1;
+    }
+
+    PERFT_CACHE cache = {NULL, 0};
+    SEARCH_TT tt = {NULL, 0};
+    SEARCH_WORKERS workers = {NULL, 0};
+    if ((kind == 1 && arg > 1 && !perft_cache_init(&cache, 64)) ||
+        (kind == 2 && (!search_tt_init(&tt, 64) ||
+                       !search_workers_init(&workers, 1)))) {
+        puts("[ERROR]: Could not allocate table");
+        if (tt.entries) search_tt_free(&tt);
+        if (fp != stdin) fclose(fp);
+        return 1;
+    }
+
+    // The line buffer is reused, so only long lines allocate
+    char* line = NULL;
+    size_t len = 0;
+    char fen[FEN_MAX];
+    int failed = 0;
+    while (getline(&line, &len, fp) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        CHESS chess;
+        CHESS_STATUS status = chess_load_fen(&chess, line);
+        if (status != CHESS_OK) {
+            printf("[ERROR]: %s `%s`\n", chess_strerror(status), line);
+            failed++;
+            continue;
+        }
+        chess_to_fen(&chess, fen);
+
+        if (kind == 0) {
+            MOVE_LIST list = init_move_list();
+            move_list_generate_moves(&list, &chess);
+            printf("%s\t%d\n", fen, list.length);
+        } else if (kind == 1) {
+            printf("%s\t%llu\n", fen,
+                   chess_perft(&chess, arg, cache.entries ? &cache : NULL));
+        } else {
+            SEARCH_LIMITS limits = init_search_limits();
+            limits.movetime = arg;
+            limits.tt = &tt;
+            limits.workers = &workers;
+            SEARCH_INFO info;
+            chess_search(&chess, &limits, &info);
+            char str[6] = "0000";
+            if (info.best_move != MOVE_NONE)
+                move_to_string(info.best_move, str);
+            printf("%s\t%s %d\n", fen, str, info.score);
+        }
+    }
+
+    if (cache.entries) perft_cache_free(&cache);
+    if (tt.entries) search_tt_free(&tt);
+    if (workers.searchers) search_workers_free(&workers);
+    if (fp != stdin) fclose(fp);
+    free(line);
+    return failed ? 1 : 0;
+}
+
+/**
+ * @brief Replays every game of the given files on threads workers, then
+ * prints "<file>\t<offset>\t<moves>\t<ok|invalid>" per game and a summary
+ *
+ */
+int run_corpus(char** filenames, int n_files, int threads) {
+    CORPUS corpus;
+    CHESS_STATUS status = corpus_replay(&corpus, filenames, n_files, threads);
+    if (status != CHESS_OK) {
+        printf("[ERROR]: Could not replay the corpus: %s\n",
+               chess_strerror(status));
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    for (size_t i = 0; i < corpus.length; i++) {
+        CORPUS_GAME* game = &corpus.games[i];
+        printf("%s\t%zu\t%d\t%s\n", filenames[game->file], game->offset,
+               game->moves, game->valid ? "ok" : "invalid");
+    }
+    long long ms = corpus.time_ms ? corpus.time_ms : 1;
+    printf("games %zu moves %llu invalid %zu time %lld games/s %llu moves/s "
+           "%llu\n",
+           corpus.length, corpus.moves, corpus.invalid, corpus.time_ms,
+           (unsigned long long)corpus.length * 1000 / ms,
+           corpus.moves * 1000 / ms);
+
+    int failed = corpus.invalid > 0;
+    corpus_free(&corpus);
+    return failed;
+}
+
+/**
+ * @brief Converts text games (one move per line, blank line between games)
+ * into the binary format. A game stops at its first bad move
+ *
+ */
+int run_pack(char* out, char** filenames, int n_files) {
+    FILE* fp = fopen(out, "wb");
+    GAME_WRITER writer;
+    if (fp == NULL || !game_writer_open(&writer, fp)) {
+        printf("Could not write file `%s`\n", out);
+        if (fp) fclose(fp);
+        return 1;
+    }
+
+    char* line = NULL;
+    size_t len = 0;
+    int failed = 0;
+    for (int f = 0; f < n_files; f++) {
+        FILE* in = fopen(filenames[f], "rb");
+        if (in == NULL) {
+            printf("Could not read file `%s`\n", filenames[f]);
+            failed = 1;
+            continue;
+        }
+        int skip = 0;
+        while (getline(&line, &len, in) != -1) {
+            size_t n = strcspn(line, "\r\n");
+            if (n == 0) {
+                if (writer.in_game) game_writer_end(&writer);
+                skip = 0;
+                continue;
+            }
+            if (skip) continue;
+            if (!writer.in_game) game_writer_begin(&writer, NULL);
+            MOVE move = chess_parse_move(&writer.chess, line, n);
+            if (move == MOVE_NONE || !game_writer_move(&writer, move)) {
+                printf("[ERROR]: Move %.*s in `%s` is not valid\n", (int)n,
+                       line, filenames[f]);
+                failed = 1;
+                skip = 1;
+            }
+        }
+        if (writer.in_game) game_writer_end(&writer);
+        fclose(in);
+    }
+    free(line);
+    if (fclose(fp)) failed = 1;
+    return failed;
+}
+
+/**
+ * @brief Prints the games of a binary file as text, one move per line
+ *
+ */
+int run_unpack(char* filename) {
+    FILE* fp = fopen(filename, "rb");
+    GAME_READER reader;
+    if (fp == NULL || !game_reader_open(&reader, fp)) {
+        printf("Could not read file `%s`\n", filename);
+        if (fp) fclose(fp);
+        return 1;
+    }
+
+    int status, games = 0;
+    char str[6];
+    while ((status = game_reader_next_game(&reader)) == 1) {
+        if (games++) putc('\n', stdout);
+        MOVE move;
+        while ((move = game_reader_next_move(&reader)) != MOVE_NONE) {
+            move_to_string(move, str);
+            puts(str);
+        }
+    }
+    fclose(fp);
+    if (status < 0) {
+        printf("[ERROR]: Corrupt game file `%s`\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets chess from "(startpos | fen FEN) [moves MOVE...]", as used by
+ * --serve and UCI. The FEN's move counters are skipped by chess_load_fen.
+ * chess is only changed on success; on a bad move, *bad_move points to it
+ *
+ */
+CHESS_STATUS load_position(CHESS* chess, char* args, char** bad_move) {
+    CHESS loaded = init_chess();
+    *bad_move = NULL;
+    if (!strncmp(args, "fen ", 4)) {
+        CHESS_STATUS status = chess_load_fen(&loaded, args + 4);
+        if (status != CHESS_OK) return status;
+    } else if (strncmp(args, "startpos", 8)) {
+        return CHESS_ERR_FEN_PLACEMENT;
+    }
+
+    char* moves = strstr(args, "moves");
+    char* save;
+    for (char* move = moves ? strtok_r(moves + 5, " ", &save) : NULL; move;
+         move = strtok_r(NULL, " ", &save)) {
+        CHESS_STATUS status = chess_move(&loaded, move);
+        if (status != CHESS_OK) {
+            *bad_move = move;
+            return status;
+        }
+    }
+    *chess = loaded;
+    return CHESS_OK;
+}
+
+#define SERVE_BUFFER (1 << 16)  // longest request line, newline included
+
+typedef struct server_s {
+    CHESS chess;
+    PERFT_CACHE cache;  // all allocated on first use, then kept
+    SEARCH_TT tt;
+    SEARCH_WORKERS workers;
+} SERVER;
+
+/**
+ * @brief Answers one request with one line. Returns 0 on quit
+ *
+ */
+int serve_request(SERVER* server, char* line) {
+    char* args = line + strcspn(line, " ");
+    if (*args) *args++ = '\0';
+    char str[6];
+
+    if (!strcmp(line, "position")) {
+        char* bad_move;
+        CHESS_STATUS status = load_position(&server->chess, args, &bad_move);
+        if (status == CHESS_OK)
+            puts("ok");
+        else if (bad_move)
+            printf("error %s %s\n", chess_strerror(status), bad_move);
+        else
+            printf("error %s\n", chess_strerror(status));
+    } else if (!strcmp(line, "move")) {
+        CHESS_STATUS status = chess_move(&server->chess, args);
+        if (status == CHESS_OK)
+            puts("ok");
+        else
+            printf("error %s\n", chess_strerror(status));
+    } else if (!strcmp(line, "moves")) {
+        MOVE_LIST list = init_move_list();
+        move_list_generate_moves(&list, &server->chess);
+        printf("moves %d", list.length);
+        for (int i = 0; i < list.length; i++) {
+            move_to_string(list.moves[i], str);
+            printf(" %s", str);
+        }
+        putc('\n', stdout);
+    } else if (!strcmp(line, "fen")) {
+        char fen[FEN_MAX];
+        chess_to_fen(&server->chess, fen);
+        printf("fen %s\n", fen);
+    } else if (!strcmp(line, "perft")) {
+        int depth = atoi(args);
+        if (depth < 1) {
+            puts("error expected a depth");
+            return 1;
+        }
+        if (!server->cache.entries) perft_cache_init(&server->cache, 64);
+        printf("perft %llu\n",
+               chess_perft(&server->chess, depth,
+                           server->cache.entries ? &server->cache : NULL));
+    } else if (!strcmp(line, "search")) {
+        // search MS
+        if (!server->tt.entries) search_tt_init(&server->tt, 64);
+        if (!server->workers.searchers)
+            search_workers_init(&server->workers, 1);
+        SEARCH_LIMITS limits = init_search_limits();
+        limits.movetime = atoi(args);
+        if (limits.movetime < 1) limits.movetime = 1000;
+        if (server->tt.entries) limits.tt = &server->tt;
+        if (server->workers.searchers) limits.workers = &server->workers;
+        SEARCH_INFO info;
+        chess_search(&server->chess, &limits, &info);
+        // No legal move: a1a1 would read as a real one
+        strcpy(str, "0000");
+        if (info.best_move != MOVE_NONE) move_to_string(info.best_move, str);
+        printf("bestmove %s score %d depth %d nodes %llu\n", str, info.score,
+               info.depth, info.nodes);
+    } else if (!strcmp(line, "stats")) {
+        // stats [reset]
+        print_stats();
+        if (!strcmp(args, "reset")) chess_stats_reset();
+    } else if (!strcmp(line, "quit")) {
+        return 0;
+    } else if (*line) {
+        puts("error unknown command");
+    }
+    return 1;
+}
+
+/**
+ * @brief Line-delimited requests on stdin, one response line each on stdout.
+ * Input is read in large blocks and the responses to a block are written
+ * together, so a pipelined client costs one read and one write per block
+ *
+ */
+int run_serve() {
+    static char buf[SERVE_BUFFER];
+    static char out[SERVE_BUFFER];
+    setvbuf(stdout, out, _IOFBF, sizeof(out));
+    SERVER server = {.chess = init_chess()};
+
+    size_t used = 0;
+    int running = 1;
+    int discarding = 0;  // inside a line already answered as too long
+    ssize_t n;
+    while (running && (n = read(STDIN_FILENO, buf + used,
+                                sizeof(buf) - used)) > 0) {
+        used += n;
+        char* start = buf;
+        char* nl;
+        while (running && (nl = memchr(start, '\n', buf + used - start))) {
+            *nl = '\0';
+            if (nl > start && nl[-1] == '\r') nl[-1] = '\0';
+            if (discarding)
+                discarding = 0;
+            else
+                running = serve_request(&server, start);
+            start = nl + 1;
+        }
+        used -= start - buf;
+        // One response per request: the rest of the line is dropped up to
+        // its newline, however many reads that takes
+        if (used == sizeof(buf)) {
+            if (!discarding) puts("error request too long");
+            discarding = 1;
+            used = 0;
+        }
+        memmove(buf, start, used);
+        fflush(stdout);
+    }
+    // A last request without a newline
+    if (running && used && !discarding) {
+        buf[used] = '\0';  // used < sizeof(buf), see above
+        serve_request(&server, buf);
+    }
+    fflush(stdout);
+
+    if (server.cache.entries) perft_cache_free(&server.cache);
+    if (server.tt.entries) search_tt_free(&server.tt);
+    if (server.workers.searchers) search_workers_free(&server.workers);
+    return 0;
+}
+
+#define UCI_DEFAULT_HASH_MB 16
+#define UCI_MAX_HASH_MB 4096
+
+/**
+ * @brief UCI session. The search runs on its own thread, so the reader can
+ * answer isready and stop while it thinks
+ *
+ */
+typedef struct uci_s {
+    CHESS chess;
+    SEARCH_TT tt;
+    SEARCH_WORKERS workers;  // sized to the Threads option
+    pthread_t search;
+    int searching;  // search has been started and not yet joined
+    int infinite;   // hold bestmove back until stop
+    atomic_int stop;
+    SEARCH_LIMITS limits;
+} UCI;
+
+// Builds the info line in one buffer, as the reader thread prints too
+void uci_report(const SEARCH_INFO* info, void* data) {
+    char line[128 + SEARCH_MAX_PLY * 6];
+    int n;
+    if (info->score > SEARCH_MATE - SEARCH_MAX_PLY)
+        n = sprintf(line, "info depth %d score mate %d", info->depth,
+                    (SEARCH_MATE - info->score + 1) / 2);
+    else if (info->score < -SEARCH_MATE + SEARCH_MAX_PLY)
+        n = sprintf(line, "info depth %d score mate %d", info->depth,
+                    -(SEARCH_MATE + info->score) / 2);
+    else
+        n = sprintf(line, "info depth %d score cp %d", info->depth,
+                    info->score);
+    n += sprintf(line + n, " nodes %llu nps %llu time %lld pv", info->nodes,
+                 info->nps, info->time_ms);
+    for (int i = 0; i < info->pv_length; i++) {
+        line[n++] = ' ';
+        move_to_string(info->pv[i], line + n);
+        n += strlen(line + n);
+    }
+    line[n++] = '\n';
+    fwrite(line, 1, n, stdout);
+}
+
+void* uci_search(void* arg) {
+    UCI* uci = arg;
+    SEARCH_INFO info;
+    chess_search(&uci->chess, &uci->limits, &info);
+    // go infinite must not answer before stop, even if the search ran out
+    while (uci->infinite && !atomic_load(&uci->stop)) {
+        struct timespec wait = {0, 1000000};
+        nanosleep(&wait, NULL);
+    }
+    char str[6] = "0000";
+    if (info.best_move != MOVE_NONE) move_to_string(info.best_move, str);
+    printf("bestmove %s\n", str);
+    return NULL;
+}
+
+void uci_stop(UCI* uci) {
+    if (!uci->searching) return;
+    atomic_store(&uci->stop, 1);
+    pthread_join(uci->search, NULL);
+    uci->searching = 0;
+}
+
+/**
+ * @brief go [depth N] [nodes N] [movetime MS] [infinite] [wtime MS] [btime MS]
+ * [winc MS] [binc MS] [movestogo N]. With a clock and no movetime, it spends
+ * the remaining time over movestogo (or 30) moves plus most of the increment
+ *
+ */
+void uci_go(UCI* uci, char* args) {
+    uci_stop(uci);
+    SEARCH_LIMITS limits = init_search_limits();
+    long long time[2] = {0, 0}, inc[2] = {0, 0};
+    int moves_to_go = 30;
+    uci->infinite = 0;
+
+    char* save;
+    for (char* token = strtok_r(args, " ", &save); token;
+         token = strtok_r(NULL, " ", &save)) {
+        if (!strcmp(token, "infinite")) {
+            uci->infinite = 1;
+            continue;
+        }
+        char* value = strtok_r(NULL, " ", &save);
+        if (value == NULL) break;
+        long long v = atoll(value);
+        if (!strcmp(token, "depth"))
+            limits.depth = v;
+        else if (!strcmp(token, "nodes"))
+            limits.nodes = v;
+        else if (!strcmp(token, "movetime"))
+            limits.movetime = v;
+        else if (!strcmp(token, "wtime"))
+            time[WHITE] = v;
+        else if (!strcmp(token, "btime"))
+            time[BLACK] = v;
+        else if (!strcmp(token, "winc"))
+            inc[WHITE] = v;
+        else if (!strcmp(token, "binc"))
+            inc[BLACK] = v;
+        else if (!strcmp(token, "movestogo") && v > 0)
+            moves_to_go = v;
+    }
+
+    int us = uci->chess.turn == 1 ? WHITE : BLACK;
+    if (!uci->infinite && !limits.movetime && time[us]) {
+        // Keep a margin for the GUI's own overhead
+        limits.movetime = time[us] / moves_to_go + inc[us] * 3 / 4;
+        if (limits.movetime > time[us] - 50) limits.movetime = time[us] - 50;
+        if (limits.movetime < 1) limits.movetime = 1;
+    }
+
+    limits.threads = uci->workers.count;
+    limits.tt = uci->tt.entries ? &uci->tt : NULL;
+    limits.workers = uci->workers.searchers ? &uci->workers : NULL;
+    limits.stop = &uci->stop;
+    limits.report = uci_report;
+    uci->limits = limits;
+    atomic_store(&uci->stop, 0);
+    if (pthread_create(&uci->search, NULL, uci_search, uci) == 0)
+        uci->searching = 1;
+    else
+        puts("bestmove 0000");
+}
+
+void uci_set_option(UCI* uci, char* args) {
+    // setoption name NAME value VALUE
+    char* name = strstr(args, "name ");
+    char* value = strstr(args, " value ");
+    if (name == NULL || value == NULL) return;
+    *value = '\0';
+    int v = atoi(value + 7);
+    if (!strcasecmp(name + 5, "Hash") && v >= 1 && v <= UCI_MAX_HASH_MB) {
+        search_tt_free(&uci->tt);
+        if (!search_tt_init(&uci->tt, v))
+            printf("info string could not allocate %d MB\n", v);
+    } else if (!strcasecmp(name + 5, "Threads") && v >= 1) {
+        search_workers_free(&uci->workers);
+        if (!search_workers_init(&uci->workers, v))
+            printf("info string could not allocate %d threads\n", v);
+    }
+}
+
+/**
+ * @brief UCI on stdin/stdout. The reader never blocks on the search: go
+ * starts it on a thread, stop and quit signal and join it
+ *
+ */
+int run_uci() {
+    // Each line must reach the GUI as soon as it is written
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    UCI uci = {.chess = init_chess(), .searching = 0};
+    atomic_init(&uci.stop, 0);
+    search_tt_init(&uci.tt, UCI_DEFAULT_HASH_MB);
+    search_workers_init(&uci.workers, 1);
+
+    char* line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, stdin) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* args = line + strcspn(line, " ");
+        if (*args) *args++ = '\0';
+
+        if (!strcmp(line, "uci")) {
+            puts("id name chess");
+            puts("id author yasteen");
+            printf("option name Hash type spin default %d min 1 max %d\n",
+                   UCI_DEFAULT_HASH_MB, UCI_MAX_HASH_MB);
+            puts("option name Threads type spin default 1 min 1 max 64");
+            puts("uciok");
+        } else if (!strcmp(line, "isready")) {
+            puts("readyok");
+        } else if (!strcmp(line, "setoption")) {
+            uci_stop(&uci);
+            uci_set_option(&uci, args);
+        } else if (!strcmp(line, "ucinewgame")) {
+            uci_stop(&uci);
+            if (uci.tt.entries) search_tt_clear(&uci.tt);
+        } else if (!strcmp(line, "position")) {
+            uci_stop(&uci);
+            char* bad_move;
+            CHESS_STATUS status = load_position(&uci.chess, args, &bad_move);
+            if (status != CHESS_OK)
+                printf("info string %s %s\n", chess_strerror(status),
+                       bad_move ? bad_move : "");
+        } else if (!strcmp(line, "go")) {
+            uci_go(&uci, args);
+        } else if (!strcmp(line, "stop")) {
+            uci_stop(&uci);
+        } else if (!strcmp(line, "quit")) {
+            break;
+        }
+    }
+    uci_stop(&uci);
+    free(line);
+    search_tt_free(&uci.tt);
+    search_workers_free(&uci.workers);
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    if (argc > 2) {
+    if (argc >= 4 && !strcmp(argv[1], "--epd"))
+        return run_epd(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0);
+    if (argc >= 4 && !strcmp(argv[1], "--corpus"))
+        return run_corpus(argv + 3, argc - 3, atoi(argv[2]));
+    if (argc >= 4 && !strcmp(argv[1], "--pack"))
+        return run_pack(argv[2], argv + 3, argc - 3);
+    if (argc == 3 && !strcmp(argv[1], "--unpack")) return run_unpack(argv[2]);
+    if (argc == 2 && !strcmp(argv[1], "--serve")) return run_serve();
+    if (argc == 2 && !strcmp(argv[1], "--uci")) return run_uci();
+
+    if (argc > 3 || (argc == 3 && strcmp(argv[1], "--fen"))) {
         puts("[USAGE]: cli [FILENAME?]");
+        puts("         cli --fen FEN");
+        puts("         cli --epd FILE (count | perft DEPTH | search MS)");
+        puts("         cli --corpus THREADS FILE...");
+        puts("         cli --pack OUT FILE...");
+        puts("         cli --unpack FILE");
+        puts("         cli --serve");
+        puts("         cli --uci");
         return 1;
     }
 
     CHESS chess = init_chess();
     MOVE_LIST list = init_move_list();
 
-    if (argc == 2) {
-        read_chess_file(argv[1], &chess, &list);
+    if (argc == 3) {
+        CHESS_STATUS status = chess_load_fen(&chess, argv[2]);
+        if (status != CHESS_OK) {
+            printf("[ERROR]: %s `%s`\n", chess_strerror(status), argv[2]);
+            return 1;
+        }
+    } else if (argc == 2) {
+        read_chess_file(argv[1], &chess);
     }
 
     print_chess_board(chess.board, 0);
 
-    for (int i = 0; i < 10000; i++) {
-        move_list_clear(&list);
-        move_list_generate_moves(&list, &chess);
-
-        char* line = NULL;
-        size_t len;
-        printf("> ");
-        getline(&line, &len, stdin);
-        len = strnlen(line, len);
-
+    // The line buffer is reused; the loop ends at end of input
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while (printf("> "), fflush(stdout),
+           (len = getline(&line, &size, stdin)) != -1) {
         // Print moves
         if (len == 2) {
             if (line[0] == 'm') {
+                move_list_clear(&list);
+                move_list_generate_moves(&list, &chess);
                 print_move_list(&list);
-                i--;
+            } else if (line[0] == 'c') {
+                print_stats();
             } else if (line[0] == 't') {
                 puts(chess.turn == 1 ? "Turn: white" : "Turn: black");
             } else if (line[0] == 'a') {
-                print_chess_board(
-                    chess.turn == 1 ? chess.b_attacking : chess.w_attacking, 1);
+                chess_update_attacking_squares(&chess);
+                BITBOARD attacking =
+                    chess.turn == 1 ? chess.b_attacking : chess.w_attacking;
+                char attack_board[64];
+                for (int j = 0; j < 64; j++)
+                    attack_board[j] = (attacking >> j) & 1;
+                print_chess_board(attack_board, 1);
+            } else if (line[0] == 'f') {
+                char fen[FEN_MAX];
+                chess_to_fen(&chess, fen);
+                puts(fen);
+            } else if (line[0] == 's') {
+                SEARCH_LIMITS limits = init_search_limits();
+                limits.movetime = 1000;
+                limits.report = print_search_info;
+                SEARCH_INFO info;
+                chess_search(&chess, &limits, &info);
+                char str[6] = "0000";
+                if (info.best_move != MOVE_NONE)
+                    move_to_string(info.best_move, str);
+                printf("bestmove %s\n", str);
             } else {
                 puts("Invalid command");
             }
@@ -97,12 +778,12 @@ int main(int argc, char** argv) {
         if (len < 5 || len > 6) {
             printf("[ERROR]: Invalid command %s\n", line);
         } else {
-            chess_move(&chess, &list, line);
+            play_move(&chess, line);
         }
 
         print_chess_board(chess.board, 0);
-        free(line);
     }
+    free(line);
     return 0;
 }
 
@@ -0,0 +1,62 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "chess.h"
+#include "helpers.h"
+#include "stats.h"
+
+/**
+ * @brief check holds key ^ data. A reader that sees halves of two different
+ * writes gets a mismatch and treats it as a miss
+ *
+ */
+struct perft_entry_s {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;  // count << 8 | depth
+};
+
+int perft_cache_init(PERFT_CACHE* cache, size_t megabytes) {
+    cache->entries = hash_table_alloc(
+        megabytes, sizeof(struct perft_entry_s), &cache->mask);
+    return cache->entries != NULL;
+}
+
+void perft_cache_free(PERFT_CACHE* cache) {
+    free(cache->entries);
+    cache->entries = NULL;
+}
+
+unsigned long long chess_perft(CHESS* chess, int depth, PERFT_CACHE* cache) {
+    if (depth < 1) return 1;
+    STATS_ADD_DEPTH(perft_nodes, depth);
+
+    struct perft_entry_s* entry = NULL;
+    if (cache && depth > 1) {
+        entry = &cache->entries[chess->key & cache->mask];
+        uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+        uint64_t check =
+            atomic_load_explicit(&entry->check, memory_order_relaxed);
+        if ((check ^ data) == chess->key && (data & 0xff) == depth)
+            return data >> 8;
+    }
+
+    MOVE_LIST moves = init_move_list();
+    move_list_generate_moves(&moves, chess);
+    if (depth == 1) return moves.length;
+
+    unsigned long long count = 0;
+    for (int i = 0; i < moves.length; i++) {
+        UNDO undo;
+        chess_make_move(chess, moves.moves[i], &undo);
+        count += chess_perft(chess, depth - 1, cache);
+        chess_unmake_move(chess, moves.moves[i], &undo);
+    }
+
+    if (entry) {
+        uint64_t data = count << 8 | depth;
+        atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+        atomic_store_explicit(&entry->check, chess->key ^ data,
+                              memory_order_relaxed);
+    }
+    return count;
+}
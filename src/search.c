@@ -0,0 +1,487 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "bitboard.h"
+#include "chess.h"
+#include "eval.h"
+#include "helpers.h"
+#include "stats.h"
+
+#define INF 32767
+#define ASPIRATION_WINDOW 50
+#define SEARCH_MAX_THREADS 64
+#define SEARCH_DEFAULT_TT_MB 16
+#define ROOT_ROTATE_SPAN 4  // root moves after the first a helper rotates
+// A capture that cannot bring the score within this of alpha is skipped
+#define DELTA_MARGIN 200
+
+// Scores this close to SEARCH_MATE are mates, stored relative to the node
+#define MATE_BOUND (SEARCH_MATE - SEARCH_MAX_PLY)
+
+enum { TT_EXACT = 1, TT_LOWER, TT_UPPER };
+
+/**
+ * @brief check holds key ^ data, so a torn write from another thread reads
+ * as a miss instead of a wrong entry
+ *
+ */
+struct search_entry_s {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;  // bound << 40 | depth << 32 | score << 16 | move
+};
+
+/**
+ * @brief State every thread of one search sees
+ *
+ */
+typedef struct search_shared_s {
+    const SEARCH_LIMITS* limits;
+    SEARCH_TT* tt;
+    long long start_ms;
+    atomic_int stop;  // set by whichever thread hits a limit first
+    _Atomic unsigned long long nodes;
+} SEARCH_SHARED;
+
+typedef struct searcher_s {
+    CHESS chess;  // each thread searches its own copy
+    SEARCH_SHARED* shared;
+    int id;  // 0 is the main thread, which reports and picks the move
+    unsigned long long nodes;
+    unsigned long long flushed;  // part of nodes already added to shared
+    int stopped;
+
+    // Triangular PV table: pv[ply] holds the line found from ply onwards
+    MOVE pv[SEARCH_MAX_PLY][SEARCH_MAX_PLY];
+    int pv_length[SEARCH_MAX_PLY];
+    // Line of the last completed depth, tried first on the next one
+    MOVE prev_pv[SEARCH_MAX_PLY];
+    int prev_pv_length;
+
+    uint64_t keys[SEARCH_MAX_PLY + 1];  // keys along the current line
+} SEARCHER;
+
+static inline int search_should_stop(SEARCHER* s);
+static inline int tt_probe(SEARCH_TT* tt, uint64_t key, uint64_t* data);
+static inline void tt_store(SEARCH_TT* tt, uint64_t key, MOVE move, int score,
+                            int depth, int bound);
+static inline int capture_gain(CHESS* chess, MOVE move);
+static int search_node(SEARCHER* s, int depth, int ply, int alpha, int beta,
+                       int on_pv);
+static int search_quiesce(SEARCHER* s, int ply, int alpha, int beta);
+static void search_iterate(SEARCHER* s, int start_depth, SEARCH_INFO* info);
+static void* search_worker(void* arg);
+
+int search_tt_init(SEARCH_TT* tt, size_t megabytes) {
+    tt->entries = hash_table_alloc(megabytes, sizeof(struct search_entry_s),
+                                   &tt->mask);
+    return tt->entries != NULL;
+}
+
+void search_tt_clear(SEARCH_TT* tt) {
+    for (size_t i = 0; i <= tt->mask; i++) {
+        atomic_store_explicit(&tt->entries[i].check, 0, memory_order_relaxed);
+        atomic_store_explicit(&tt->entries[i].data, 0, memory_order_relaxed);
+    }
+}
+
+void search_tt_free(SEARCH_TT* tt) {
+    free(tt->entries);
+    tt->entries = NULL;
+}
+
+int search_workers_init(SEARCH_WORKERS* workers, int count) {
+    if (count > SEARCH_MAX_THREADS) count = SEARCH_MAX_THREADS;
+    workers->searchers = count > 0 ? calloc(count, sizeof(SEARCHER)) : NULL;
+    workers->count = workers->searchers ? count : 0;
+    return workers->searchers != NULL;
+}
+
+void search_workers_free(SEARCH_WORKERS* workers) {
+    free(workers->searchers);
+    workers->searchers = NULL;
+    workers->count = 0;
+}
+
+SEARCH_LIMITS init_search_limits() {
+    SEARCH_LIMITS limits = {.depth = 0,
+                            .threads = 1,
+                            .tt = NULL,
+                            .workers = NULL,
+                            .nodes = 0,
+                            .movetime = 0,
+                            .stop = NULL,
+                            .report = NULL,
+                            .report_data = NULL};
+    return limits;
+}
+
+/**
+ * @brief Lazy SMP: every thread runs its own iterative deepening on the same
+ * root and they only cooperate through the transposition table. Helpers start
+ * on staggered depths so they fill the table ahead of the main thread, and
+ * each tries the root moves in its own order so they split the work.
+ *
+ * Without limits->tt each call allocates and frees a 16 MB table, and
+ * without limits->workers a block of searcher state per thread. Callers that
+ * search more than once should pass both, made with search_tt_init and
+ * search_workers_init, which also keeps what the table learned between
+ * searches. threads is capped to workers->count
+ *
+ */
+void chess_search(CHESS* chess, const SEARCH_LIMITS* limits,
+                  SEARCH_INFO* info) {
+    SEARCH_SHARED shared = {.limits = limits,
+                            .tt = limits->tt,
+                            .start_ms = now_ms(),
+                            .stop = 0,
+                            .nodes = 0};
+    SEARCH_TT local_tt = {NULL, 0};
+    if (shared.tt == NULL) {
+        if (search_tt_init(&local_tt, SEARCH_DEFAULT_TT_MB))
+            shared.tt = &local_tt;
+    }
+
+    int threads = limits->threads < 1 ? 1 : limits->threads;
+    if (threads > SEARCH_MAX_THREADS) threads = SEARCH_MAX_THREADS;
+
+    SEARCH_WORKERS local_workers = {NULL, 0};
+    SEARCH_WORKERS* workers = limits->workers;
+    if (workers == NULL) {
+        // Fewer threads beat no search when memory is short
+        while (threads > 0 && !search_workers_init(&local_workers, threads))
+            threads /= 2;
+        workers = &local_workers;
+    }
+    if (threads > workers->count) threads = workers->count;
+
+    SEARCHER* searchers = workers->searchers;
+    pthread_t handles[SEARCH_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        SEARCHER* s = &searchers[i];
+        copy_chess(chess, &s->chess);
+        s->shared = &shared;
+        s->id = i;
+        s->nodes = s->flushed = 0;
+        s->stopped = 0;
+        s->prev_pv_length = 0;
+        s->keys[0] = chess->key;
+    }
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&handles[i], NULL, search_worker, &searchers[i]))
+            break;
+        started = i;
+    }
+
+    info->best_move = MOVE_NONE;
+    info->score = 0;
+    info->depth = 0;
+    info->pv_length = 0;
+
+    // Something to play even if the first depth gets cut off
+    MOVE_LIST moves = init_move_list();
+    move_list_generate_moves(&moves, chess);
+    if (moves.length) info->best_move = moves.moves[0];
+    // Nothing to search: a mated root scores as search_node scores mate
+    if (!moves.length && chess->under_check) info->score = -SEARCH_MATE;
+
+    if (threads > 0 && moves.length) search_iterate(&searchers[0], 1, info);
+
+    atomic_store(&shared.stop, 1);
+    for (int i = 1; i <= started; i++) pthread_join(handles[i], NULL);
+
+    info->nodes = 0;
+    for (int i = 0; i < threads; i++) info->nodes += searchers[i].nodes;
+    info->time_ms = now_ms() - shared.start_ms;
+    info->nps = info->nodes * 1000 / (info->time_ms ? info->time_ms : 1);
+    if (local_tt.entries) search_tt_free(&local_tt);
+    if (local_workers.searchers) search_workers_free(&local_workers);
+}
+
+// HELPERS
+
+static inline int search_should_stop(SEARCHER* s) {
+    SEARCH_SHARED* shared = s->shared;
+    const SEARCH_LIMITS* limits = shared->limits;
+    unsigned long long nodes = atomic_fetch_add_explicit(
+                                   &shared->nodes, s->nodes - s->flushed,
+                                   memory_order_relaxed) +
+                               s->nodes - s->flushed;
+    s->flushed = s->nodes;
+
+    if (atomic_load_explicit(&shared->stop, memory_order_relaxed)) return 1;
+    if ((limits->stop &&
+         atomic_load_explicit(limits->stop, memory_order_relaxed)) ||
+        (limits->nodes && nodes >= limits->nodes) ||
+        (limits->movetime &&
+         now_ms() - shared->start_ms >= limits->movetime)) {
+        atomic_store_explicit(&shared->stop, 1, memory_order_relaxed);
+        return 1;
+    }
+    return 0;
+}
+
+static inline int tt_probe(SEARCH_TT* tt, uint64_t key, uint64_t* data) {
+    if (tt == NULL) return 0;
+    struct search_entry_s* entry = &tt->entries[key & tt->mask];
+    *data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    return (check ^ *data) == key && *data != 0;
+}
+
+static inline void tt_store(SEARCH_TT* tt, uint64_t key, MOVE move, int score,
+                            int depth, int bound) {
+    if (tt == NULL) return;
+    struct search_entry_s* entry = &tt->entries[key & tt->mask];
+    uint64_t data = (uint64_t)bound << 40 | (uint64_t)depth << 32 |
+                    (uint64_t)(uint16_t)score << 16 | move;
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+}
+
+// Roughly the most material move can win: the victim plus any promotion
+static inline int capture_gain(CHESS* chess, MOVE move) {
+    int them = chess->turn == 1 ? BLACK : WHITE;
+    int gain = 0;
+    if (move_flag(move) == MOVE_EN_PASSANT) {
+        gain = eval_piece_value[PAWN];
+    } else {
+        BITBOARD to = BIT(move_end(move));
+        for (int type = PAWN; type < KING; type++)
+            if (chess->pieces[them][type] & to) gain = eval_piece_value[type];
+    }
+    if (move_flag(move) == MOVE_PROMOTION)
+        gain += eval_piece_value[KNIGHT + ((move >> 12) & 3)] -
+                eval_piece_value[PAWN];
+    return gain;
+}
+
+static int search_node(SEARCHER* s, int depth, int ply, int alpha, int beta,
+                       int on_pv) {
+    if (depth <= 0) return search_quiesce(s, ply, alpha, beta);
+    CHESS* chess = &s->chess;
+    s->pv_length[ply] = 0;
+
+    // Checking the clock is slow, so only do it every 1024 nodes
+    if ((s->nodes & 1023) == 0 && search_should_stop(s)) s->stopped = 1;
+    if (s->stopped) return 0;
+    s->nodes++;
+    STATS_ADD_DEPTH(search_nodes, ply);
+
+    // Repeating a position on the current line is scored as a draw
+    for (int i = ply - 2; i >= 0; i -= 2)
+        if (s->keys[i] == chess->key) return 0;
+
+    if (ply >= SEARCH_MAX_PLY - 1) return chess_evaluate(chess);
+
+    MOVE hash_move = MOVE_NONE;
+    uint64_t data;
+    if (tt_probe(s->shared->tt, chess->key, &data)) {
+        hash_move = data & 0xffff;
+        int tt_score = (int16_t)(data >> 16);
+        int tt_depth = (data >> 32) & 0xff;
+        int tt_bound = (data >> 40) & 3;
+        if (tt_score > MATE_BOUND) tt_score -= ply;
+        if (tt_score < -MATE_BOUND) tt_score += ply;
+        // Not on the PV: a cutoff there would leave the reported line short
+        if (ply > 0 && !on_pv && tt_depth >= depth &&
+            (tt_bound == TT_EXACT ||
+             (tt_bound == TT_LOWER && tt_score >= beta) ||
+             (tt_bound == TT_UPPER && tt_score <= alpha)))
+            return tt_score;
+    }
+    if (on_pv && ply < s->prev_pv_length) hash_move = s->prev_pv[ply];
+
+    MOVE_PICKER picker;
+    move_picker_init(&picker, chess, hash_move);
+
+    // At the root each helper rotates the few moves after the first, so it
+    // opens on a different subtree than the main thread and the other helpers
+    MOVE root[MOVE_LIST_MAX];
+    int root_length = 0, root_next = 0;
+    int rotate = ply == 0 && s->id > 0;
+    if (rotate) {
+        while ((root[root_length] = move_picker_next(&picker)) != MOVE_NONE)
+            root_length++;
+        int span = root_length - 1 < ROOT_ROTATE_SPAN ? root_length - 1
+                                                      : ROOT_ROTATE_SPAN;
+        for (int n = span > 1 ? s->id % span : 0; n > 0; n--) {
+            MOVE first = root[1];
+            for (int i = 1; i < span; i++) root[i] = root[i + 1];
+            root[span] = first;
+        }
+    }
+
+    int alpha_start = alpha;
+    int best = -INF;
+    MOVE best_move = MOVE_NONE;
+    int legal = 0;
+    MOVE move;
+    while ((move = rotate ? root[root_next++] : move_picker_next(&picker)) !=
+           MOVE_NONE) {
+        legal++;
+        UNDO undo;
+        chess_make_move(chess, move, &undo);
+        s->keys[ply + 1] = chess->key;
+        int score = -search_node(s, depth - 1, ply + 1, -beta, -alpha,
+                                 on_pv && move == hash_move);
+        chess_unmake_move(chess, move, &undo);
+        if (s->stopped) return 0;
+
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                best_move = move;
+                s->pv[ply][ply] = move;
+                for (int i = ply + 1; i < s->pv_length[ply + 1]; i++)
+                    s->pv[ply][i] = s->pv[ply + 1][i];
+                s->pv_length[ply] =
+                    s->pv_length[ply + 1] > ply + 1 ? s->pv_length[ply + 1]
+                                                    : ply + 1;
+                if (score >= beta) break;
+            }
+        }
+    }
+
+    // No legal moves: checkmate or stalemate
+    if (!legal) return chess->under_check ? -SEARCH_MATE + ply : 0;
+
+    int bound = best >= beta          ? TT_LOWER
+                : best > alpha_start ? TT_EXACT
+                                     : TT_UPPER;
+    int tt_score = best;
+    if (tt_score > MATE_BOUND) tt_score += ply;
+    if (tt_score < -MATE_BOUND) tt_score -= ply;
+    tt_store(s->shared->tt, chess->key,
+             bound == TT_UPPER ? picker.hash_move : best_move, tt_score, depth,
+             bound);
+    return best;
+}
+
+/**
+ * @brief Searches captures and promotions until the position is quiet, so the
+ * horizon never falls in the middle of an exchange. Out of check the side to
+ * move may stand pat on the static evaluation; in check every evasion is
+ * searched instead, and having none is mate
+ *
+ */
+static int search_quiesce(SEARCHER* s, int ply, int alpha, int beta) {
+    CHESS* chess = &s->chess;
+    s->pv_length[ply] = 0;
+
+    if ((s->nodes & 1023) == 0 && search_should_stop(s)) s->stopped = 1;
+    if (s->stopped) return 0;
+    s->nodes++;
+    STATS_ADD_DEPTH(search_nodes, ply);
+
+    if (ply >= SEARCH_MAX_PLY - 1) return chess_evaluate(chess);
+
+    int us = chess->turn == 1 ? WHITE : BLACK;
+    int in_check = chess_king_attacked(chess, us);
+
+    int best = -INF, stand_pat = 0;
+    if (!in_check) {
+        stand_pat = chess_evaluate(chess);
+        if (stand_pat >= beta) return stand_pat;
+        if (stand_pat > alpha) alpha = stand_pat;
+        best = stand_pat;
+    }
+
+    MOVE_PICKER picker;
+    move_picker_init_tactical(&picker, chess);
+    MOVE move;
+    while ((move = move_picker_next(&picker)) != MOVE_NONE) {
+        if (!in_check) {
+            // Delta pruning, then captures that lose material outright
+            if (stand_pat + capture_gain(chess, move) + DELTA_MARGIN <= alpha)
+                continue;
+            if (move_flag(move) != MOVE_PROMOTION && chess_see(chess, move) < 0)
+                continue;
+        }
+        UNDO undo;
+        chess_make_move(chess, move, &undo);
+        // The tactical picker leaves legality to us, and only for the moves
+        // that get this far
+        if (chess_king_attacked(chess, us)) {
+            chess_unmake_move(chess, move, &undo);
+            continue;
+        }
+        int score = -search_quiesce(s, ply + 1, -beta, -alpha);
+        chess_unmake_move(chess, move, &undo);
+        if (s->stopped) return 0;
+
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (score >= beta) break;
+            }
+        }
+    }
+
+    if (best == -INF) return -SEARCH_MATE + ply;
+    return best;
+}
+
+/**
+ * @brief Iterative deepening with aspiration windows. Only the main thread
+ * passes info, which is filled and reported after every completed depth
+ *
+ */
+static void search_iterate(SEARCHER* s, int start_depth, SEARCH_INFO* info) {
+    const SEARCH_LIMITS* limits = s->shared->limits;
+    int max_depth = limits->depth > 0 && limits->depth < SEARCH_MAX_PLY
+                        ? limits->depth
+                        : SEARCH_MAX_PLY - 1;
+    int last_score = 0;
+    for (int depth = start_depth; depth <= max_depth; depth++) {
+        int alpha = -INF, beta = INF, delta = ASPIRATION_WINDOW;
+        if (depth >= 4) {
+            alpha = last_score - delta;
+            beta = last_score + delta;
+        }
+
+        int score;
+        for (;;) {
+            score = search_node(s, depth, 0, alpha, beta, 1);
+            if (s->stopped) break;
+            // Widen whichever side failed and search again
+            if (score <= alpha) {
+                alpha = score - delta < -INF ? -INF : score - delta;
+            } else if (score >= beta) {
+                beta = score + delta > INF ? INF : score + delta;
+            } else {
+                break;
+            }
+            delta *= 2;
+        }
+        if (s->stopped) break;
+
+        last_score = score;
+        s->prev_pv_length = s->pv_length[0];
+        for (int i = 0; i < s->pv_length[0]; i++) s->prev_pv[i] = s->pv[0][i];
+
+        if (info) {
+            for (int i = 0; i < s->pv_length[0]; i++) info->pv[i] = s->pv[0][i];
+            info->pv_length = s->pv_length[0];
+            if (info->pv_length) info->best_move = info->pv[0];
+            info->score = score;
+            info->depth = depth;
+            info->nodes = atomic_load(&s->shared->nodes) + s->nodes - s->flushed;
+            info->time_ms = now_ms() - s->shared->start_ms;
+            info->nps =
+                info->nodes * 1000 / (info->time_ms ? info->time_ms : 1);
+            if (limits->report) limits->report(info, limits->report_data);
+        }
+
+        // Nothing left to find once a forced mate is in view
+        if (abs(score) >= SEARCH_MATE - depth) break;
+    }
+}
+
+static void* search_worker(void* arg) {
+    SEARCHER* s = arg;
+    search_iterate(s, 1 + (s->id & 1), NULL);
+    return NULL;
+}
@@ -0,0 +1,67 @@
+#include "stats.h"
+
+#include <string.h>
+
+#ifdef USE_STATS
+#include <pthread.h>
+#include <stdlib.h>
+
+#define STATS_FIELDS (sizeof(CHESS_STATS) / sizeof(unsigned long long))
+
+typedef struct stats_node_s {
+    CHESS_STATS stats;
+    struct stats_node_s* next;
+} STATS_NODE;
+
+_Thread_local CHESS_STATS* stats_local;
+// Threads that cannot allocate a block of their own share this one. It is
+// always on the list, so their counts are summed too, though increments from
+// two such threads at once can be lost
+static STATS_NODE stats_fallback;
+// Blocks outlive their threads, so the counts of finished workers stay
+static STATS_NODE* stats_head = &stats_fallback;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+CHESS_STATS* stats_register() {
+    STATS_NODE* node = calloc(1, sizeof(STATS_NODE));
+    if (node == NULL) return stats_local = &stats_fallback.stats;
+    pthread_mutex_lock(&stats_lock);
+    node->next = stats_head;
+    stats_head = node;
+    pthread_mutex_unlock(&stats_lock);
+    return stats_local = &node->stats;
+}
+
+int chess_stats_enabled() { return 1; }
+
+/**
+ * @brief Other threads may still be counting, so the sums are a snapshot
+ * that can be a few increments behind
+ *
+ */
+void chess_stats_get(CHESS_STATS* stats) {
+    memset(stats, 0, sizeof(CHESS_STATS));
+    unsigned long long* sum = (unsigned long long*)stats;
+    pthread_mutex_lock(&stats_lock);
+    for (STATS_NODE* node = stats_head; node; node = node->next) {
+        unsigned long long* counts = (unsigned long long*)&node->stats;
+        for (size_t i = 0; i < STATS_FIELDS; i++) sum[i] += counts[i];
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void chess_stats_reset() {
+    pthread_mutex_lock(&stats_lock);
+    for (STATS_NODE* node = stats_head; node; node = node->next)
+        memset(&node->stats, 0, sizeof(CHESS_STATS));
+    pthread_mutex_unlock(&stats_lock);
+}
+#else
+int chess_stats_enabled() { return 0; }
+
+void chess_stats_get(CHESS_STATS* stats) {
+    memset(stats, 0, sizeof(CHESS_STATS));
+}
+
+void chess_stats_reset() {}
+#endif
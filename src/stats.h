@@ -0,0 +1,35 @@
+#ifndef CHESS_STATS_H
+#define CHESS_STATS_H
+
+#include "chess.h"
+
+#ifdef USE_STATS
+#include <time.h>
+
+// Each thread counts into its own block, registered on first use
+extern _Thread_local CHESS_STATS* stats_local;
+CHESS_STATS* stats_register();
+
+static inline CHESS_STATS* stats_block() {
+    return stats_local ? stats_local : stats_register();
+}
+
+static inline unsigned long long stats_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define STATS_ADD(field, n) (stats_block()->field += (n))
+#define STATS_ADD_DEPTH(field, depth) \
+    ((depth) < STATS_MAX_DEPTH ? stats_block()->field[depth]++ : 0)
+#define STATS_TIMER_START() unsigned long long stats_start_ns = stats_now_ns()
+#define STATS_TIMER_STOP(field) STATS_ADD(field, stats_now_ns() - stats_start_ns)
+#else
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_ADD_DEPTH(field, depth) ((void)0)
+#define STATS_TIMER_START() ((void)0)
+#define STATS_TIMER_STOP(field) ((void)0)
+#endif
+
+#endif
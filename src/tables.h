@@ -0,0 +1,38 @@
+#ifndef CHESS_TABLES_H
+#define CHESS_TABLES_H
+
+#include "chess.h"
+
+/**
+ * @brief Lookup for one slider on one square: relevant occupancy mask, magic
+ * multiplier and the slice of the shared attack table it indexes into
+ *
+ */
+typedef struct magic_s {
+    BITBOARD mask;
+    BITBOARD magic;
+    const BITBOARD* attacks;
+    int shift;
+} MAGIC;
+
+// Defined in tables.c, which tools/gen_tables.c writes at build time, so they
+// are ready before main and safe to read from any thread
+
+extern const BITBOARD knight_attacks[64];
+extern const BITBOARD king_attacks[64];
+extern const BITBOARD pawn_attacks[2][64];  // [color][square]
+// Squares from a square to the edge, direction as in dir_offsets
+extern const BITBOARD ray_squares[8][64];
+// Squares strictly between two aligned squares, 0 otherwise
+extern const BITBOARD between_squares[64][64];
+// Full edge-to-edge line through two aligned squares, 0 otherwise
+extern const BITBOARD line_squares[64][64];
+extern const MAGIC rook_magics[64];
+extern const MAGIC bishop_magics[64];
+
+extern const uint64_t zobrist_pieces[2][6][64];
+extern const uint64_t zobrist_castle[16];
+extern const uint64_t zobrist_en_passant[8];  // indexed by bit, like P/p
+extern const uint64_t zobrist_black;
+
+#endif
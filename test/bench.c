@@ -0,0 +1,83 @@
+#include <stdio.h>
+
+#include "../src/chess.h"
+#include "../src/helpers.h"
+
+typedef struct bench_position_s {
+    const char* name;
+    const char* fen;
+    int depth;
+    unsigned long long expected;
+} BENCH_POSITION;
+
+/**
+ * @brief Reference perft counts: the usual chessprogramming positions, then
+ * small positions that each stress one castling, en passant, promotion or
+ * check rule
+ *
+ */
+static const BENCH_POSITION POSITIONS[] = {
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 6,
+     119060324},
+    {"kiwipete",
+     "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 5,
+     193690690},
+    {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+    {"position4",
+     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5,
+     15833292},
+    {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     5, 89941194},
+    {"position6",
+     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+     5, 164075551},
+    {"ep-pinned-rook", "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 6, 1134888},
+    {"ep-pinned-bishop", "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1", 6, 1015133},
+    {"ep-gives-check", "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467},
+    {"castle-short-check", "5k2/8/8/8/8/8/8/4K2R w K - 0 1", 6, 661072},
+    {"castle-long-check", "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1", 6, 803711},
+    {"castle-rights", "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1", 4, 1274206},
+    {"castle-prevented", "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4,
+     1720476},
+    {"promote-out-of-check", "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1", 6, 3821001},
+    {"discovered-check", "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 5, 1004658},
+    {"promote-to-check", "4k3/1P6/8/8/8/8/K7/8 w - - 0 1", 6, 217342},
+    {"underpromote-to-check", "8/P1k5/K7/8/8/8/8/8 w - - 0 1", 6, 92683},
+    {"self-stalemate", "K1k5/8/P7/8/8/8/8/8 w - - 0 1", 6, 2217},
+    {"stalemate-checkmate-1", "8/k1P5/8/1K6/8/8/8/8 w - - 0 1", 7, 567584},
+    {"stalemate-checkmate-2", "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1", 4, 23527},
+};
+
+/**
+ * Runs every reference position without a cache and prints one tab-separated
+ * row per position, then a total row. Exits with 1 if any count is off.
+ *  */
+int main() {
+    int n = sizeof(POSITIONS) / sizeof(POSITIONS[0]);
+    int mismatches = 0;
+    unsigned long long total_nodes = 0;
+    long long total_ms = 0;
+
+    puts("name\tdepth\tnodes\texpected\ttime_ms\tnps\tstatus");
+    for (int i = 0; i < n; i++) {
+        const BENCH_POSITION* pos = &POSITIONS[i];
+        CHESS chess;
+        if (chess_load_fen(&chess, pos->fen) != CHESS_OK) return 2;
+
+        long long start = now_ms();
+        unsigned long long nodes = chess_perft(&chess, pos->depth, NULL);
+        long long ms = now_ms() - start;
+
+        int ok = nodes == pos->expected;
+        mismatches += !ok;
+        total_nodes += nodes;
+        total_ms += ms;
+        printf("%s\t%d\t%llu\t%llu\t%lld\t%llu\t%s\n", pos->name, pos->depth,
+               nodes, pos->expected, ms, nodes * 1000 / (ms ? ms : 1),
+               ok ? "ok" : "MISMATCH");
+    }
+    printf("total\t-\t%llu\t-\t%lld\t%llu\t%d mismatches\n", total_nodes,
+           total_ms, total_nodes * 1000 / (total_ms ? total_ms : 1),
+           mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/chess.h"
+#include "../src/eval.h"
+
+/**
+ * Consistency checks that perft counts cannot catch. Each check prints one
+ * line and returns the number of failures.
+ */
+
+typedef struct unpack_case_s {
+    const char* fen;
+    int en_passant;        // file + 1, written over the snapshot's byte
+    const char* expected;  // FEN unpacked, NULL if it must be rejected
+} UNPACK_CASE;
+
+static const UNPACK_CASE UNPACK_CASES[] = {
+    {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq - 0 3", 4,
+     "rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 1"},
+    {"4k3/8/8/8/3Pp3/8/8/4K3 b - - 0 1", 4, "4k3/8/8/8/3Pp3/8/8/4K3 b - d3 0 1"},
+    // d6 holds white's own knight
+    {"7k/8/3N4/3pP3/8/8/8/4K3 w - - 0 1", 4, NULL},
+    // No black pawn on d5 to take
+    {"7k/8/8/4P3/8/8/8/4K3 w - - 0 1", 4, NULL},
+    // The pawn on d4 is black's own
+    {"4k3/8/8/8/3pp3/8/8/4K3 b - - 0 1", 4, NULL},
+};
+
+typedef struct root_case_s {
+    const char* fen;
+    int score;  // chess_search's score for a root without legal moves
+} ROOT_CASE;
+
+static const ROOT_CASE ROOT_CASES[] = {
+    {"7k/6Q1/6K1/8/8/8/8/8 b - - 0 1", -SEARCH_MATE},
+    {"k7/8/1Q6/8/8/8/8/7K b - - 0 1", 0},
+};
+
+typedef struct walk_position_s {
+    const char* fen;
+    int depth;
+} WALK_POSITION;
+
+// Positions the walks start from: the usual perft positions, then small ones
+// with en passant, castling and promotion edge cases
+static const WALK_POSITION WALK_POSITIONS[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 3},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 3},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+     3},
+    {"3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 4},
+    {"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 4},
+    {"r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4},
+    {"2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1", 4},
+    {"8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 4},
+};
+#define WALK_POSITIONS_LENGTH \
+    (int)(sizeof(WALK_POSITIONS) / sizeof(WALK_POSITIONS[0]))
+
+typedef struct fen_case_s {
+    const char* fen;
+    CHESS_STATUS expected;
+} FEN_CASE;
+
+static const FEN_CASE FEN_CASES[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", CHESS_OK},
+    {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 3", CHESS_OK},
+    {"4k3/8/8/8/3Pp3/8/8/4K3 b - d3 0 1", CHESS_OK},
+    // No black pawn on e5 to take
+    {"4k3/8/8/3P4/8/8/8/4K3 w - e6 0 1", CHESS_ERR_FEN_EN_PASSANT},
+    // The pawn on e5 is white's own
+    {"4k3/8/8/3PP3/8/8/8/4K3 w - e6 0 1", CHESS_ERR_FEN_EN_PASSANT},
+    // The pawn could not have crossed e7
+    {"4k3/4n3/8/3Pp3/8/8/8/4K3 w - e6 0 1", CHESS_ERR_FEN_EN_PASSANT},
+    {"4k3/8/8/8/3Pp3/8/8/4K3 w - d3 0 1", CHESS_ERR_FEN_EN_PASSANT},
+    // Black to move could take the white king
+    {"4k3/4R3/8/8/8/8/8/4K3 w - - 0 1", CHESS_ERR_FEN_PLACEMENT},
+    {"4k3/8/8/8/8/8/3p4/4K3 b - - 0 1", CHESS_ERR_FEN_PLACEMENT},
+    {"4k3/8/8/8/8/8/3p4/4K3 w - - 0 1", CHESS_OK},
+};
+
+static int check_fen() {
+    int n = sizeof(FEN_CASES) / sizeof(FEN_CASES[0]);
+    int failures = 0;
+    for (int i = 0; i < n; i++) {
+        CHESS chess;
+        CHESS_STATUS status = chess_load_fen(&chess, FEN_CASES[i].fen);
+        if (status != FEN_CASES[i].expected) {
+            printf("  %s: got %s, expected %s\n", FEN_CASES[i].fen,
+                   chess_strerror(status),
+                   chess_strerror(FEN_CASES[i].expected));
+            failures++;
+        }
+    }
+    printf("fen\t%d cases\t%s\n", n, failures ? "FAIL" : "ok");
+    return failures;
+}
+
+/**
+ * @brief A snapshot's en passant square must pass the checks chess_load_fen
+ * makes on a FEN's
+ *
+ */
+static int check_unpack() {
+    int n = sizeof(UNPACK_CASES) / sizeof(UNPACK_CASES[0]);
+    int failures = 0;
+    for (int i = 0; i < n; i++) {
+        const UNPACK_CASE* test = &UNPACK_CASES[i];
+        CHESS chess, unpacked;
+        unsigned char buf[PACKED_MAX];
+        if (chess_load_fen(&chess, test->fen) != CHESS_OK) {
+            printf("  %s: does not load\n", test->fen);
+            failures++;
+            continue;
+        }
+        int length = chess_pack_position(&chess, buf);
+        buf[length - 1] = test->en_passant;
+        char fen[FEN_MAX] = "rejected";
+        if (chess_unpack_position(&unpacked, buf, length))
+            chess_to_fen(&unpacked, fen);
+        if (strcmp(fen, test->expected ? test->expected : "rejected")) {
+            printf("  %s with en passant file %d: got %s\n", test->fen,
+                   test->en_passant, fen);
+            failures++;
+        }
+    }
+    printf("unpack\t%d cases\t%s\n", n, failures ? "FAIL" : "ok");
+    return failures;
+}
+
+/**
+ * @brief A mated or stalemated root has nothing to search, but must still
+ * score as mate or draw and offer no move
+ *
+ */
+static int check_search_root() {
+    int n = sizeof(ROOT_CASES) / sizeof(ROOT_CASES[0]);
+    int failures = 0;
+    for (int i = 0; i < n; i++) {
+        CHESS chess;
+        if (chess_load_fen(&chess, ROOT_CASES[i].fen) != CHESS_OK) {
+            printf("  %s: does not load\n", ROOT_CASES[i].fen);
+            failures++;
+            continue;
+        }
+        SEARCH_LIMITS limits = init_search_limits();
+        limits.depth = 1;
+        SEARCH_INFO info;
+        chess_search(&chess, &limits, &info);
+        if (info.best_move != MOVE_NONE || info.score != ROOT_CASES[i].score) {
+            printf("  %s: score %d, expected %d\n", ROOT_CASES[i].fen,
+                   info.score, ROOT_CASES[i].score);
+            failures++;
+        }
+    }
+    printf("search_root\t%d cases\t%s\n", n, failures ? "FAIL" : "ok");
+    return failures;
+}
+
+/**
+ * @brief Every one of the 65536 move encodings must be accepted by
+ * chess_is_legal exactly when move generation produces it, and the string of
+ * each legal move must parse back to it. Only every few moves are followed
+ * further down, or the walk would take minutes
+ *
+ */
+static int is_legal_walk(CHESS* chess, int depth, long* positions) {
+    static char generated[1 << 16];
+    MOVE_LIST list = init_move_list();
+    move_list_generate_moves(&list, chess);
+    memset(generated, 0, sizeof(generated));
+    for (int i = 0; i < list.length; i++) generated[list.moves[i]] = 1;
+
+    int failures = 0;
+    char fen[FEN_MAX], str[6];
+    for (int move = 0; move < 1 << 16; move++) {
+        if (chess_is_legal(chess, move) == generated[move]) continue;
+        if (failures++ < 5) {
+            chess_to_fen(chess, fen);
+            move_to_string(move, str);
+            printf("  %s: %s %04x is_legal %d, generated %d\n", fen, str,
+                   move, !generated[move], generated[move]);
+        }
+    }
+    for (int i = 0; i < list.length; i++) {
+        move_to_string(list.moves[i], str);
+        if (chess_parse_move(chess, str, strlen(str)) == list.moves[i])
+            continue;
+        if (failures++ < 5) {
+            chess_to_fen(chess, fen);
+            printf("  %s: %s does not parse back\n", fen, str);
+        }
+    }
+    (*positions)++;
+
+    if (depth == 0) return failures;
+    for (int i = 0; i < list.length; i += depth > 1 ? 3 : 5) {
+        UNDO undo;
+        chess_make_move(chess, list.moves[i], &undo);
+        failures += is_legal_walk(chess, depth - 1, positions);
+        chess_unmake_move(chess, list.moves[i], &undo);
+    }
+    return failures;
+}
+
+static int check_is_legal() {
+    int failures = 0;
+    long positions = 0;
+    for (int i = 0; i < WALK_POSITIONS_LENGTH; i++) {
+        CHESS chess;
+        if (chess_load_fen(&chess, WALK_POSITIONS[i].fen) != CHESS_OK) {
+            printf("  %s: does not load\n", WALK_POSITIONS[i].fen);
+            failures++;
+            continue;
+        }
+        failures += is_legal_walk(&chess, WALK_POSITIONS[i].depth, &positions);
+    }
+    printf("is_legal\t%ld positions\t%s\n", positions,
+           failures ? "FAIL" : "ok");
+    return failures;
+}
+
+/**
+ * @brief The evaluation terms added up from the board, the slow way the
+ * incremental update in chess_put_piece and chess_remove_piece replaces
+ *
+ */
+static void eval_recount(CHESS* chess, int* mg, int* eg, int* phase) {
+    *mg = *eg = *phase = 0;
+    for (int square = 0; square < 64; square++) {
+        char piece = chess->board[square];
+        if (piece == NON) continue;
+        int type = strchr("pnbrqk", tolower(piece)) - "pnbrqk";
+        int white = isupper(piece);
+        int sign = white ? 1 : -1;
+        *mg += sign * eval_mg[type][white ? square : square ^ 56];
+        *eg += sign * eval_eg[type][white ? square : square ^ 56];
+        *phase += eval_phase[type];
+    }
+}
+
+static int eval_compare(CHESS* chess, const char* when) {
+    int mg, eg, phase;
+    eval_recount(chess, &mg, &eg, &phase);
+    if (mg == chess->eval_mg && eg == chess->eval_eg && phase == chess->phase)
+        return 0;
+    char fen[FEN_MAX];
+    chess_to_fen(chess, fen);
+    printf("  %s after %s: mg %d eg %d phase %d, recount %d %d %d\n", fen,
+           when, chess->eval_mg, chess->eval_eg, chess->phase, mg, eg, phase);
+    return 1;
+}
+
+#define EVAL_WALKS 64
+#define EVAL_WALK_PLIES 200
+
+/**
+ * @brief Random games from each walk position, comparing the incremental
+ * evaluation with a recount after every make and again after every unmake on
+ * the way back
+ *
+ */
+static int check_eval() {
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    int failures = 0;
+    long moves = 0;
+    for (int i = 0; i < WALK_POSITIONS_LENGTH; i++) {
+        for (int walk = 0; walk < EVAL_WALKS; walk++) {
+            CHESS chess;
+            if (chess_load_fen(&chess, WALK_POSITIONS[i].fen) != CHESS_OK) {
+                printf("  %s: does not load\n", WALK_POSITIONS[i].fen);
+                failures++;
+                break;
+            }
+            MOVE line[EVAL_WALK_PLIES];
+            UNDO undo[EVAL_WALK_PLIES];
+            int ply = 0;
+            for (; ply < EVAL_WALK_PLIES && failures < 5; ply++) {
+                MOVE_LIST list = init_move_list();
+                move_list_generate_moves(&list, &chess);
+                if (list.length == 0) break;
+                // xorshift64, so every run walks the same games
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                line[ply] = list.moves[seed % list.length];
+                chess_make_move(&chess, line[ply], &undo[ply]);
+                failures += eval_compare(&chess, "make");
+                moves++;
+            }
+            while (ply-- > 0) {
+                chess_unmake_move(&chess, line[ply], &undo[ply]);
+                failures += eval_compare(&chess, "unmake");
+            }
+        }
+    }
+    printf("eval\t%ld moves\t%s\n", moves, failures ? "FAIL" : "ok");
+    return failures;
+}
+
+/**
+ * @brief Pseudo-legal moves of each kind that do not leave the king attacked
+ * must be the legal moves of that kind, in any order
+ *
+ */
+static int pseudo_legal_walk(CHESS* chess, int depth, long* positions) {
+    static const int KINDS[] = {GEN_ALL, GEN_CAPTURES, GEN_QUIETS,
+                                GEN_TACTICAL};
+    static const char* KIND_NAMES[] = {"all", "captures", "quiets",
+                                       "tactical"};
+    static char legal[1 << 16];
+    int us = chess->turn == 1 ? WHITE : BLACK;
+    int failures = 0;
+    for (int k = 0; k < 4; k++) {
+        MOVE_LIST list = init_move_list(), pseudo = init_move_list();
+        switch (KINDS[k]) {
+            case GEN_ALL:
+                move_list_generate_moves(&list, chess);
+                break;
+            case GEN_CAPTURES:
+                move_list_generate_captures(&list, chess);
+                break;
+            case GEN_QUIETS:
+                move_list_generate_quiets(&list, chess);
+                break;
+            default:
+                move_list_generate_tactical(&list, chess);
+                break;
+        }
+        move_list_generate_pseudo_legal(&pseudo, chess, KINDS[k]);
+
+        memset(legal, 0, sizeof(legal));
+        for (int i = 0; i < list.length; i++) legal[list.moves[i]] = 1;
+        int kept = 0, wrong = 0;
+        for (int i = 0; i < pseudo.length; i++) {
+            UNDO undo;
+            chess_make_move(chess, pseudo.moves[i], &undo);
+            int left_in_check = chess_king_attacked(chess, us);
+            chess_unmake_move(chess, pseudo.moves[i], &undo);
+            if (left_in_check) continue;
+            kept++;
+            if (!legal[pseudo.moves[i]]) wrong++;
+        }
+        if (kept == list.length && !wrong) continue;
+        if (failures++ < 5) {
+            char fen[FEN_MAX];
+            chess_to_fen(chess, fen);
+            printf("  %s: %s kept %d of %d pseudo-legal, %d legal\n", fen,
+                   KIND_NAMES[k], kept, pseudo.length, list.length);
+        }
+    }
+    (*positions)++;
+
+    if (depth == 0) return failures;
+    MOVE_LIST list = init_move_list();
+    move_list_generate_moves(&list, chess);
+    for (int i = 0; i < list.length; i++) {
+        UNDO undo;
+        chess_make_move(chess, list.moves[i], &undo);
+        failures += pseudo_legal_walk(chess, depth - 1, positions);
+        chess_unmake_move(chess, list.moves[i], &undo);
+    }
+    return failures;
+}
+
+static int check_pseudo_legal() {
+    int failures = 0;
+    long positions = 0;
+    for (int i = 0; i < WALK_POSITIONS_LENGTH; i++) {
+        CHESS chess;
+        if (chess_load_fen(&chess, WALK_POSITIONS[i].fen) != CHESS_OK) {
+            printf("  %s: does not load\n", WALK_POSITIONS[i].fen);
+            failures++;
+            continue;
+        }
+        failures +=
+            pseudo_legal_walk(&chess, WALK_POSITIONS[i].depth - 1, &positions);
+    }
+    printf("pseudo_legal\t%ld positions\t%s\n", positions,
+           failures ? "FAIL" : "ok");
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    failures += check_fen();
+    failures += check_unpack();
+    failures += check_search_root();
+    failures += check_is_legal();
+    failures += check_eval();
+    failures += check_pseudo_legal();
+    return failures ? 1 : 0;
+}
@@ -1,18 +1,45 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "../src/chess.h"
 
 typedef struct result_s {
-    int* totals;    // [n]
-    int* per_move;  // [n][20]
+    long long* totals;    // [n]
+    long long* per_move;  // [n][20]
     int n;
 } RESULT;
 
+/**
+ * @brief A subtree two plies below the root, handed to whichever worker
+ * claims it next
+ *
+ */
+typedef struct task_s {
+    int mov;
+    MOVE moves[2];  // root move, reply
+} TASK;
+
+typedef struct pool_s {
+    CHESS root;
+    TASK* tasks;
+    int length;
+    atomic_int next;
+    int n;
+    PERFT_CACHE* cache;
+} POOL;
+
+typedef struct worker_s {
+    pthread_t thread;
+    POOL* pool;
+    RESULT result;  // private to the worker; merged after join
+} WORKER;
+
 RESULT init_result(int n) {
     RESULT r = {.n = n,
-                .totals = malloc(n * sizeof(int)),
-                .per_move = malloc(n * sizeof(int) * 20)};
+                .totals = calloc(n, sizeof(long long)),
+                .per_move = calloc(n * 20, sizeof(long long))};
     return r;
 }
 void free_result(RESULT* result) {
@@ -28,17 +55,34 @@ void gen_moves(CHESS* chess, int mov, int n, RESULT* results) {
     results->totals[n - 1] += moves.length;
     results->per_move[(n - 1) * 20 + mov] += moves.length;
     for (int i = 0; i < moves.length; i++) {
-        CHESS cpy;
-        copy_chess(chess, &cpy);
-        chess_valid_move(&cpy, moves.moves[i]);
-        gen_moves(&cpy, mov, n - 1, results);
+        UNDO undo;
+        chess_make_move(chess, moves.moves[i], &undo);
+        gen_moves(chess, mov, n - 1, results);
+        chess_unmake_move(chess, moves.moves[i], &undo);
+    }
+}
+
+/**
+ * Adds the same counts as gen_moves. With a cache, each depth is counted by
+ * its own chess_perft call so that transposed subtrees come from the cache.
+ *  */
+void count_moves(CHESS* chess, int mov, int n, RESULT* results,
+                 PERFT_CACHE* cache) {
+    if (cache == NULL) {
+        gen_moves(chess, mov, n, results);
+        return;
+    }
+    for (int d = 1; d <= n; d++) {
+        unsigned long long count = chess_perft(chess, d, cache);
+        results->totals[n - d] += count;
+        results->per_move[(n - d) * 20 + mov] += count;
     }
 }
 
 /**
  * results is [n][20]
  *  */
-int gen_moves_start(int n, RESULT* results) {
+int gen_moves_start(int n, RESULT* results, PERFT_CACHE* cache) {
     CHESS chess = init_chess();
     MOVE_LIST moves = init_move_list();
     move_list_generate_moves(&moves, &chess);
@@ -51,42 +95,136 @@ int gen_moves_start(int n, RESULT* results) {
     results->totals[n - 1] += moves.length;
     for (int i = 0; i < moves.length; i++) {
         results->per_move[(n - 1) * 20 + i] = 1;
-        CHESS cpy;
-        copy_chess(&chess, &cpy);
-        chess_valid_move(&cpy, moves.moves[i]);
-        gen_moves(&cpy, i, n - 1, results);
+        UNDO undo;
+        chess_make_move(&chess, moves.moves[i], &undo);
+        count_moves(&chess, i, n - 1, results, cache);
+        chess_unmake_move(&chess, moves.moves[i], &undo);
     }
 
     return 0;
 }
 
+void* gen_moves_worker(void* arg) {
+    WORKER* worker = arg;
+    POOL* pool = worker->pool;
+    CHESS chess;
+    copy_chess(&pool->root, &chess);
+
+    int i;
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->length) {
+        TASK* task = &pool->tasks[i];
+        UNDO undo[2];
+        chess_make_move(&chess, task->moves[0], &undo[0]);
+        chess_make_move(&chess, task->moves[1], &undo[1]);
+        count_moves(&chess, task->mov, pool->n - 2, &worker->result,
+                    pool->cache);
+        chess_unmake_move(&chess, task->moves[1], &undo[1]);
+        chess_unmake_move(&chess, task->moves[0], &undo[0]);
+    }
+    return NULL;
+}
+
+/**
+ * Same counts as gen_moves_start, but the subtrees below the first two plies
+ * are shared out to `threads` workers. Each worker counts into its own
+ * RESULT, so the only shared writes are the task counter and the lockless
+ * perft cache.
+ *  */
+int gen_moves_start_parallel(int n, int threads, RESULT* results,
+                             PERFT_CACHE* cache) {
+    if (n < 3 || threads < 2) return gen_moves_start(n, results, cache);
+
+    POOL pool = {
+        .root = init_chess(), .length = 0, .next = 0, .n = n, .cache = cache};
+    MOVE_LIST moves = init_move_list();
+    move_list_generate_moves(&moves, &pool.root);
+    if (moves.length != 20) {
+        printf("There should be 20 possible moves for white at turn 1; got %d",
+               moves.length);
+        return -1;
+    }
+    pool.tasks = malloc(moves.length * MOVE_LIST_MAX * sizeof(TASK));
+
+    results->totals[n - 1] += moves.length;
+    for (int i = 0; i < moves.length; i++) {
+        results->per_move[(n - 1) * 20 + i] = 1;
+        UNDO undo;
+        chess_make_move(&pool.root, moves.moves[i], &undo);
+        MOVE_LIST replies = init_move_list();
+        move_list_generate_moves(&replies, &pool.root);
+        results->totals[n - 2] += replies.length;
+        results->per_move[(n - 2) * 20 + i] += replies.length;
+        for (int j = 0; j < replies.length; j++) {
+            TASK task = {.mov = i,
+                         .moves = {moves.moves[i], replies.moves[j]}};
+            pool.tasks[pool.length++] = task;
+        }
+        chess_unmake_move(&pool.root, moves.moves[i], &undo);
+    }
+
+    WORKER* workers = malloc(threads * sizeof(WORKER));
+    for (int t = 0; t < threads; t++) {
+        workers[t].pool = &pool;
+        workers[t].result = init_result(n);
+        pthread_create(&workers[t].thread, NULL, gen_moves_worker,
+                       &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        for (int d = 0; d < n; d++) {
+            results->totals[d] += workers[t].result.totals[d];
+            for (int m = 0; m < 20; m++)
+                results->per_move[d * 20 + m] +=
+                    workers[t].result.per_move[d * 20 + m];
+        }
+        free_result(&workers[t].result);
+    }
+
+    free(workers);
+    free(pool.tasks);
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        puts("Requires one argument");
+    if (argc < 2 || argc > 4) {
+        puts("[USAGE]: init_test DEPTH [THREADS] [HASH_MB]");
         return 1;
     }
 
     int n = atoi(argv[1]);
+    int threads = argc >= 3 ? atoi(argv[2]) : 1;
+    size_t hash_mb = argc == 4 ? atoi(argv[3]) : 0;
+
+    PERFT_CACHE cache;
+    if (hash_mb && !perft_cache_init(&cache, hash_mb)) {
+        puts("Could not allocate perft cache");
+        return 1;
+    }
+
     RESULT result = init_result(n);
-    if (gen_moves_start(n, &result) == -1) return 1;
+    if (gen_moves_start_parallel(n, threads, &result,
+                                 hash_mb ? &cache : NULL) == -1)
+        return 1;
+    if (hash_mb) perft_cache_free(&cache);
 
     CHESS c = init_chess();
     MOVE_LIST m = init_move_list();
     move_list_generate_moves(&m, &c);
     char labels[20][5];
     for (int i = 0; i < 20; i++) {
-        labels[i][0] = (m.moves[i].start % 8) + 'a';
-        labels[i][1] = (m.moves[i].start / 8) + '1';
-        labels[i][2] = (m.moves[i].end % 8) + 'a';
-        labels[i][3] = (m.moves[i].end / 8) + '1';
+        labels[i][0] = (move_start(m.moves[i]) % 8) + 'a';
+        labels[i][1] = (move_start(m.moves[i]) / 8) + '1';
+        labels[i][2] = (move_end(m.moves[i]) % 8) + 'a';
+        labels[i][3] = (move_end(m.moves[i]) / 8) + '1';
         labels[i][4] = '\0';
     }
 
     for (int i = 0; i < n; i++) {
         for (int j = 0; j < 20; j++)
-            printf("%s: %d\n", labels[j],
+            printf("%s: %lld\n", labels[j],
                    result.per_move[(n - 1 - i) * 20 + j]);
-        printf("Depth: %d    Count: %d\n\n", i + 1, result.totals[n - 1 - i]);
+        printf("Depth: %d    Count: %lld\n\n", i + 1,
+               result.totals[n - 1 - i]);
     }
 
     free_result(&result);
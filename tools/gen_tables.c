@@ -0,0 +1,289 @@
+/**
+ * @brief Prints src/tables.c: every lookup table the library reads, worked
+ * out here once so the library has nothing to set up at startup. The
+ * Makefile builds this with the library's CFLAGS, so USE_PEXT picks the
+ * matching slider table layout
+ *
+ */
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "../src/helpers.h"
+
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
+typedef uint64_t BITBOARD;
+
+#define BIT(sq) (1ULL << (sq))
+
+// Sized for the sum of 2^(relevant bits) over all squares
+#define ROOK_TABLE_SIZE 0x19000
+#define BISHOP_TABLE_SIZE 0x1480
+
+typedef struct gen_magic_s {
+    BITBOARD mask;
+    BITBOARD magic;
+    int offset;  // into the slider's attack table
+    int shift;
+} GEN_MAGIC;
+
+static const int dir_offsets[8] = {8, 9, 1, -7, -8, -9, -1, 7};
+static const int KNIGHT_MOVE[8][2] = {
+    {-2, -1}, {-2, 1}, {2, -1}, {2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2},
+};
+
+static int num_squares_to_edge[64][8];
+static BITBOARD knight_attacks[64];
+static BITBOARD king_attacks[64];
+static BITBOARD pawn_attacks[2][64];
+static BITBOARD ray_squares[8][64];
+static BITBOARD between_squares[64][64];
+static BITBOARD line_squares[64][64];
+static GEN_MAGIC rook_magics[64];
+static GEN_MAGIC bishop_magics[64];
+static BITBOARD rook_table[ROOK_TABLE_SIZE];
+static BITBOARD bishop_table[BISHOP_TABLE_SIZE];
+static uint64_t zobrist[2 * 6 * 64 + 16 + 8 + 1];
+
+static void init_geometry();
+static void init_magics(GEN_MAGIC* magics, BITBOARD* table, int start_dir);
+static void print_array(const char* decl, const BITBOARD* values,
+                        const int* dims, int depth);
+static void print_magics(const char* name, const GEN_MAGIC* magics,
+                         const char* table);
+
+int main() {
+    init_geometry();
+    init_magics(rook_magics, rook_table, 0);
+    init_magics(bishop_magics, bishop_table, 1);
+    uint64_t seed = 1070372;
+    for (int i = 0; i < (int)(sizeof(zobrist) / sizeof(zobrist[0])); i++)
+        zobrist[i] = random_u64(&seed);
+
+    puts("// Generated by tools/gen_tables.c. Do not edit\n");
+    puts("#include \"tables.h\"\n");
+
+    puts("const int dir_offsets[8] = {8, 9, 1, -7, -8, -9, -1, 7};\n");
+    puts("const int num_squares_to_edge[64][8] = {");
+    for (int sq = 0; sq < 64; sq++) {
+        printf("    {");
+        for (int dir = 0; dir < 8; dir++)
+            printf(dir ? ", %d" : "%d", num_squares_to_edge[sq][dir]);
+        puts("},");
+    }
+    puts("};\n");
+
+    print_array("const BITBOARD knight_attacks[64]", knight_attacks, (int[]){64},
+                1);
+    print_array("const BITBOARD king_attacks[64]", king_attacks, (int[]){64}, 1);
+    print_array("const BITBOARD pawn_attacks[2][64]", pawn_attacks[0],
+                (int[]){2, 64}, 2);
+    print_array("const BITBOARD ray_squares[8][64]", ray_squares[0],
+                (int[]){8, 64}, 2);
+    print_array("const BITBOARD between_squares[64][64]", between_squares[0],
+                (int[]){64, 64}, 2);
+    print_array("const BITBOARD line_squares[64][64]", line_squares[0],
+                (int[]){64, 64}, 2);
+
+    print_array("static const BITBOARD rook_table[0x19000]", rook_table,
+                (int[]){ROOK_TABLE_SIZE}, 1);
+    print_array("static const BITBOARD bishop_table[0x1480]", bishop_table,
+                (int[]){BISHOP_TABLE_SIZE}, 1);
+    print_magics("rook_magics", rook_magics, "rook_table");
+    print_magics("bishop_magics", bishop_magics, "bishop_table");
+
+    print_array("const uint64_t zobrist_pieces[2][6][64]", zobrist,
+                (int[]){2, 6, 64}, 3);
+    print_array("const uint64_t zobrist_castle[16]", zobrist + 768, (int[]){16},
+                1);
+    print_array("const uint64_t zobrist_en_passant[8]", zobrist + 784,
+                (int[]){8}, 1);
+    printf("const uint64_t zobrist_black = 0x%" PRIx64 "ULL;\n", zobrist[792]);
+    return 0;
+}
+
+// HELPERS
+
+static void init_geometry() {
+    for (int sq = 0; sq < 64; sq++) {
+        int file = sq % 8, rank = sq / 8;
+        num_squares_to_edge[sq][0] = 7 - rank;
+        num_squares_to_edge[sq][1] = MIN(7 - rank, 7 - file);
+        num_squares_to_edge[sq][2] = 7 - file;
+        num_squares_to_edge[sq][3] = MIN(7 - file, rank);
+        num_squares_to_edge[sq][4] = rank;
+        num_squares_to_edge[sq][5] = MIN(rank, file);
+        num_squares_to_edge[sq][6] = file;
+        num_squares_to_edge[sq][7] = MIN(file, 7 - rank);
+    }
+
+    for (int sq = 0; sq < 64; sq++) {
+        int x = sq % 8, y = sq / 8;
+        for (int i = 0; i < 8; i++) {
+            int kx = x + KNIGHT_MOVE[i][0];
+            int ky = y + KNIGHT_MOVE[i][1];
+            if (kx >= 0 && kx <= 7 && ky >= 0 && ky <= 7)
+                knight_attacks[sq] |= BIT(kx + 8 * ky);
+
+            if (num_squares_to_edge[sq][i] > 0)
+                king_attacks[sq] |= BIT(sq + dir_offsets[i]);
+        }
+        if (y < 7) {
+            if (x != 0) pawn_attacks[0][sq] |= BIT(sq + 7);
+            if (x != 7) pawn_attacks[0][sq] |= BIT(sq + 9);
+        }
+        if (y > 0) {
+            if (x != 0) pawn_attacks[1][sq] |= BIT(sq - 9);
+            if (x != 7) pawn_attacks[1][sq] |= BIT(sq - 7);
+        }
+    }
+
+    for (int sq = 0; sq < 64; sq++) {
+        for (int dir = 0; dir < 8; dir++) {
+            BITBOARD ray = 0;
+            for (int n = 1; n <= num_squares_to_edge[sq][dir]; n++) {
+                int target = sq + dir_offsets[dir] * n;
+                between_squares[sq][target] = ray;
+                ray |= BIT(target);
+            }
+            ray_squares[dir][sq] = ray;
+        }
+        // Whole line = both rays out of sq plus sq itself
+        for (int dir = 0; dir < 8; dir++) {
+            BITBOARD line = ray_squares[dir][sq] |
+                            ray_squares[(dir + 4) % 8][sq] | BIT(sq);
+            for (int n = 1; n <= num_squares_to_edge[sq][dir]; n++)
+                line_squares[sq][sq + dir_offsets[dir] * n] = line;
+        }
+    }
+}
+
+/**
+ * @brief Ray attacks walked one square at a time. Rooks use the even
+ * directions of dir_offsets (start_dir 0), bishops the odd ones (start_dir 1)
+ *
+ */
+static BITBOARD sliding_attacks(int sq, BITBOARD occupied, int start_dir) {
+    BITBOARD attacks = 0;
+    for (int dir = start_dir; dir < 8; dir += 2) {
+        for (int n = 1; n <= num_squares_to_edge[sq][dir]; n++) {
+            int target = sq + dir_offsets[dir] * n;
+            attacks |= BIT(target);
+            if (occupied & BIT(target)) break;
+        }
+    }
+    return attacks;
+}
+
+/**
+ * @brief Squares whose occupancy changes the attacks from sq; the last square
+ * of each ray never blocks anything, so it is left out
+ *
+ */
+static BITBOARD sliding_mask(int sq, int start_dir) {
+    BITBOARD mask = 0;
+    for (int dir = start_dir; dir < 8; dir += 2)
+        for (int n = 1; n < num_squares_to_edge[sq][dir]; n++)
+            mask |= BIT(sq + dir_offsets[dir] * n);
+    return mask;
+}
+
+static void init_magics(GEN_MAGIC* magics, BITBOARD* table, int start_dir) {
+    static BITBOARD occupancy[4096], reference[4096];
+#ifndef USE_PEXT
+    static int epoch[4096];
+    // Per-rank seeds known to find every magic within a few tries
+    static const uint64_t SEEDS[8] = {728,   10316, 55013, 32803,
+                                      12281, 15100, 16645, 255};
+    int attempt = 0;
+    uint64_t seed = 0;
+#endif
+
+    int offset = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        GEN_MAGIC* m = &magics[sq];
+        BITBOARD* attacks = table + offset;
+        m->mask = sliding_mask(sq, start_dir);
+        m->shift = 64 - __builtin_popcountll(m->mask);
+        m->offset = offset;
+
+        // Carry-rippler trick to enumerate every subset of the mask
+        int size = 0;
+        BITBOARD b = 0;
+        do {
+            occupancy[size] = b;
+            reference[size] = sliding_attacks(sq, b, start_dir);
+            size++;
+            b = (b - m->mask) & m->mask;
+        } while (b);
+        offset += size;
+
+#ifdef USE_PEXT
+        m->magic = 0;
+        for (int i = 0; i < size; i++)
+            attacks[_pext_u64(occupancy[i], m->mask)] = reference[i];
+#else
+        seed = SEEDS[sq / 8];
+        for (int i = 0; i < size;) {
+            do {
+                m->magic = random_u64(&seed) & random_u64(&seed) &
+                           random_u64(&seed);
+            } while (__builtin_popcountll((m->magic * m->mask) >> 56) < 6);
+
+            // A magic is good if no two occupancies with different attacks
+            // land on the same index
+            attempt++;
+            for (i = 0; i < size; i++) {
+                unsigned idx = (occupancy[i] * m->magic) >> m->shift;
+                if (epoch[idx] < attempt) {
+                    epoch[idx] = attempt;
+                    attacks[idx] = reference[i];
+                } else if (attacks[idx] != reference[i]) {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+/**
+ * @brief Prints the initializer of an array with dims[0] x ... x dims[depth -
+ * 1] entries, four values to a line
+ *
+ */
+static const BITBOARD* print_values(const BITBOARD* values, const int* dims,
+                                    int depth, int indent) {
+    printf("{");
+    for (int i = 0; i < dims[0]; i++) {
+        if (depth > 1) {
+            printf("\n%*s", indent + 4, "");
+            values = print_values(values, dims + 1, depth - 1, indent + 4);
+            printf(",");
+        } else {
+            if (i % 4 == 0) printf("\n%*s", indent + 4, "");
+            printf(i % 4 ? " 0x%" PRIx64 "ULL," : "0x%" PRIx64 "ULL,", *values++);
+        }
+    }
+    printf("\n%*s}", indent, "");
+    return values;
+}
+
+static void print_array(const char* decl, const BITBOARD* values,
+                        const int* dims, int depth) {
+    printf("%s = ", decl);
+    print_values(values, dims, depth, 0);
+    puts(";\n");
+}
+
+static void print_magics(const char* name, const GEN_MAGIC* magics,
+                         const char* table) {
+    printf("const MAGIC %s[64] = {\n", name);
+    for (int sq = 0; sq < 64; sq++)
+        printf("    {0x%" PRIx64 "ULL, 0x%" PRIx64 "ULL, %s + %d, %d},\n",
+               magics[sq].mask, magics[sq].magic, table, magics[sq].offset,
+               magics[sq].shift);
+    puts("};\n");
+}